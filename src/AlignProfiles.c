@@ -30,6 +30,12 @@
 // for math functions
 #include <math.h>
 
+// for malloc/free
+#include <stdlib.h>
+
+// for memset/memcpy
+#include <string.h>
+
 // DECIPHER header file
 #include "DECIPHER.h"
 
@@ -55,61 +61,200 @@ static double traceback(int i, int j, int *o, double *pnorm, double *snorm, int
 	return d;
 }
 
-SEXP alignProfiles(SEXP p, SEXP s, SEXP type, SEXP subMatrix, SEXP dbnMatrix, SEXP pm, SEXP mm, SEXP go, SEXP ge, SEXP exp, SEXP power, SEXP endGapPenaltyLeft, SEXP endGapPenaltyRight, SEXP boundary, SEXP norm, SEXP nThreads)
+// scoring parameters shared by every alignment
+typedef struct {
+	double PM, MM, GO, GE, EX, POW1, POW2;
+	double bound, slope, duration; // restriction
+	double egpL, egpR; // terminal gaps
+	double *subM; // substitution matrix or NULL
+	double *structM; // structure matrix or NULL
+	int d; // number of structure states
+	int normalize;
+} Params;
+
+// buffers pooled across the alignments performed by one thread
+typedef struct {
+	float *f;
+	int *i;
+	double *d;
+	size_t nf, ni, nd; // capacity
+	size_t uf, ui, ud; // in use
+} Workspace;
+
+// gaps to insert in the pattern and subject
+typedef struct {
+	int p_count, s_count;
+	int *p_ats, *p_ins, *s_ats, *s_ins;
+} Gaps;
+
+static void getParams(Params *par, SEXP subMatrix, SEXP structMatrix, SEXP pm, SEXP mm, SEXP go, SEXP ge, SEXP exp, SEXP power, SEXP endGapPenaltyLeft, SEXP endGapPenaltyRight, SEXP boundary, SEXP norm)
 {
-	int i, j, k, start, end, *rans, count, z, totM = 0;
-	double *pprofile, *sprofile, gp, gs, lGp, lGs, S, M, GP, GS, temp, avgM = 0;
-	double max, tot;
-	SEXP ans1, ans2, ans3, ans4, dims;
-	
-	pprofile = REAL(p);
-	sprofile = REAL(s);
-	double PM = asReal(pm);
-	double MM = asReal(mm);
-	double GO = asReal(go);
-	double GE = asReal(ge);
-	double EX = asReal(exp);
-	double POW1 = REAL(power)[0];
-	double POW2 = REAL(power)[1];
-	double bound = REAL(boundary)[0];
-	double slope = REAL(boundary)[1]*100.4092;
-	double duration = REAL(boundary)[2];
-	double egpL = asReal(endGapPenaltyLeft);
-	double egpR = asReal(endGapPenaltyRight);
-//	int RNA = asInteger(type);
-	
-	double *subM;
-	int do_subM;
+	SEXP dims;
+	
+	par->PM = isNull(pm) ? 0 : asReal(pm);
+	par->MM = isNull(mm) ? 0 : asReal(mm);
+	par->GO = asReal(go);
+	par->GE = asReal(ge);
+	par->EX = asReal(exp);
+	par->POW1 = REAL(power)[0];
+	par->POW2 = REAL(power)[1];
+	par->bound = REAL(boundary)[0];
+	par->slope = REAL(boundary)[1]*100.4092;
+	par->duration = REAL(boundary)[2];
+	par->egpL = asReal(endGapPenaltyLeft);
+	par->egpR = asReal(endGapPenaltyRight);
+	par->normalize = asInteger(norm);
+	
 	if (length(subMatrix) == 0) {
-		do_subM = 0;
+		par->subM = NULL;
 	} else {
-		do_subM = 1;
-		subM = REAL(subMatrix);
+		par->subM = REAL(subMatrix);
 	}
-	int normalize = asInteger(norm);
-	int nthreads = asInteger(nThreads);
-	int NTHREADS = nthreads;
 	
-	double *dbnM = REAL(dbnMatrix);
-	int do_DBN, d, size = 8;
-	if (length(dbnMatrix) > 0) {
-		do_DBN = 1;
-		PROTECT(dims = GET_DIM(dbnMatrix));
-		d = INTEGER(dims)[0];
+	if (length(structMatrix) > 0) {
+		par->structM = REAL(structMatrix);
+		PROTECT(dims = GET_DIM(structMatrix));
+		par->d = INTEGER(dims)[0];
 		UNPROTECT(1);
-		size += d;
 	} else {
-		do_DBN = 0;
-		d = 0;
+		par->structM = NULL;
+		par->d = 0;
+	}
+}
+
+// grow the buffers if necessary and zero the portion that will be used,
+// returning zero on success or one if memory could not be allocated
+static int reserveWorkspace(Workspace *w, size_t nf, size_t ni, size_t nd)
+{
+	if (nf > w->nf) {
+		free(w->f);
+		w->f = (float *) malloc(nf*sizeof(float)); // thread-safe on Windows
+		w->nf = (w->f == NULL) ? 0 : nf;
+	}
+	if (ni > w->ni) {
+		free(w->i);
+		w->i = (int *) malloc(ni*sizeof(int)); // thread-safe on Windows
+		w->ni = (w->i == NULL) ? 0 : ni;
+	}
+	if (nd > w->nd) {
+		free(w->d);
+		w->d = (double *) malloc(nd*sizeof(double)); // thread-safe on Windows
+		w->nd = (w->d == NULL) ? 0 : nd;
+	}
+	if (nf > w->nf || ni > w->ni || nd > w->nd)
+		return 1; // out of memory
+	memset(w->f, 0, nf*sizeof(float));
+	memset(w->i, 0, ni*sizeof(int));
+	memset(w->d, 0, nd*sizeof(double));
+	w->uf = 0;
+	w->ui = 0;
+	w->ud = 0;
+	return 0;
+}
+
+static float *takeFloats(Workspace *w, size_t n)
+{
+	float *ptr = w->f + w->uf;
+	w->uf += n;
+	return ptr;
+}
+
+static int *takeInts(Workspace *w, size_t n)
+{
+	int *ptr = w->i + w->ui;
+	w->ui += n;
+	return ptr;
+}
+
+static double *takeDoubles(Workspace *w, size_t n)
+{
+	double *ptr = w->d + w->ud;
+	w->ud += n;
+	return ptr;
+}
+
+static void freeWorkspace(Workspace *w)
+{
+	free(w->f);
+	free(w->i);
+	free(w->d);
+}
+
+// convert the gaps to a list of insertion positions and lengths
+static SEXP gapsAsList(Gaps *g)
+{
+	int i;
+	SEXP ans1, ans2, ans3, ans4, ret_list;
+	
+	PROTECT(ans1 = allocVector(INTSXP, g->p_count));
+	PROTECT(ans2 = allocVector(INTSXP, g->p_count));
+	for (i = 0; i < g->p_count; i++) {
+		INTEGER(ans1)[i] = g->p_ats[i];
+		INTEGER(ans2)[i] = g->p_ins[i];
+	}
+	PROTECT(ans3 = allocVector(INTSXP, g->s_count));
+	PROTECT(ans4 = allocVector(INTSXP, g->s_count));
+	for (i = 0; i < g->s_count; i++) {
+		INTEGER(ans3)[i] = g->s_ats[i];
+		INTEGER(ans4)[i] = g->s_ins[i];
 	}
+	free(g->p_ats);
+	
+	PROTECT(ret_list = allocVector(VECSXP, 4));
+	SET_VECTOR_ELT(ret_list, 0, ans1);
+	SET_VECTOR_ELT(ret_list, 1, ans2);
+	SET_VECTOR_ELT(ret_list, 2, ans3);
+	SET_VECTOR_ELT(ret_list, 3, ans4);
+	
+	UNPROTECT(5);
+	
+	return ret_list;
+}
+
+// aligns two nucleotide profiles using the buffers in the workspace,
+// returning zero on success or one if memory could not be allocated
+static int alignDNA(const double *pprofile, int lp, const double *sprofile, int ls, const Params *par, int nthreads, Workspace *w, Gaps *g)
+{
+	int i, j, k, start, end, count, z, totM = 0;
+	double gp, gs, lGp, lGs, S, M, GP, GS, temp, avgM = 0;
+	double max, tot;
+	
+	double PM = par->PM;
+	double MM = par->MM;
+	double GO = par->GO;
+	double GE = par->GE;
+	double EX = par->EX;
+	double POW1 = par->POW1;
+	double POW2 = par->POW2;
+	double bound = par->bound;
+	double slope = par->slope;
+	double duration = par->duration;
+	double egpL = par->egpL;
+	double egpR = par->egpR;
+	
+	double *subM = par->subM;
+	int do_subM = subM != NULL;
+	int normalize = par->normalize;
+	int NTHREADS = nthreads;
+	
+	double *dbnM = par->structM;
+	int d = par->d;
+	int do_DBN = d > 0;
+	int size = 8 + d;
 	
-	R_len_t lp = length(p)/size;
-	R_len_t ls = length(s)/size;
 	int l = lp + ls;
+	g->p_count = 0;
+	g->s_count = 0;
+	g->p_ats = NULL;
+	if (reserveWorkspace(w,
+		(size_t)(lp + 1)*(ls + 1) + l, // m and scoreLastG*
+		(size_t)lp*ls + 6*(size_t)l, // o, posLastG*, t, and gaps
+		3*(size_t)l + (lp > ls ? lp : ls) + 1)) // norms, starts, stops, and zip
+		return 1;
 	
 	// create arrays of normalization factors (coverge^POW)
-	double *pnorm = Calloc(lp, double); // initialized to zero
-	double *snorm = Calloc(ls, double); // initialized to zero
+	double *pnorm = takeDoubles(w, lp); // initialized to zero
+	double *snorm = takeDoubles(w, ls); // initialized to zero
 	for (i = 0; i < lp; i++)
 		if (pprofile[7 + size*i] > 0)
 			pnorm[i] = pow(pprofile[7 + size*i], POW1)*pow(1 - pprofile[4 + size*i], POW2);
@@ -201,14 +346,14 @@ SEXP alignProfiles(SEXP p, SEXP s, SEXP type, SEXP subMatrix, SEXP dbnMatrix, SE
 		}
 	}
 */	
-	float *m = Calloc((lp+1)*(ls+1), float); // initialized to zero
-	int *o = Calloc(lp*ls, int); // initialized to zero
+	float *m = takeFloats(w, (lp+1)*(ls+1)); // initialized to zero
+	int *o = takeInts(w, lp*ls); // initialized to zero
 	
 	// initialize arrays for recording the last gap that existed
-	float *scoreLastGp = Calloc(lp, float); // initialized to zero
-	float *scoreLastGs = Calloc(ls, float); // initialized to zero
-	int *posLastGp = Calloc(lp, int); // initialized to zero
-	int *posLastGs = Calloc(ls, int); // initialized to zero
+	float *scoreLastGp = takeFloats(w, lp); // initialized to zero
+	float *scoreLastGs = takeFloats(w, ls); // initialized to zero
+	int *posLastGp = takeInts(w, lp); // initialized to zero
+	int *posLastGs = takeInts(w, ls); // initialized to zero
 
 	// zipfian distribution for gap cost
 	if (lp > ls) {
@@ -216,15 +361,15 @@ SEXP alignProfiles(SEXP p, SEXP s, SEXP type, SEXP subMatrix, SEXP dbnMatrix, SE
 	} else {
 		j = ls;
 	}
-	double *zip = Calloc(j + 1, double); // initialized to zero
+	double *zip = takeDoubles(w, j + 1); // initialized to zero
 	for (i = 1; i <= j; i++)
 		zip[i] = pow((double)i, EX);
 		
 	// deterine the fraction of sequences starting or ending
-	double *pstarts = Calloc(lp, double); // initialized to zero
-	double *pstops = Calloc(lp, double); // initialized to zero
-	double *sstarts = Calloc(ls, double); // initialized to zero
-	double *sstops = Calloc(ls, double); // initialized to zero
+	double *pstarts = takeDoubles(w, lp); // initialized to zero
+	double *pstops = takeDoubles(w, lp); // initialized to zero
+	double *sstarts = takeDoubles(w, ls); // initialized to zero
+	double *sstops = takeDoubles(w, ls); // initialized to zero
 	double past, current;
 	past = 0;
 	for (i = 0; i < lp; i++) {
@@ -625,11 +770,6 @@ SEXP alignProfiles(SEXP p, SEXP s, SEXP type, SEXP subMatrix, SEXP dbnMatrix, SE
 		}
 	}
 	
-	Free(posLastGp);
-	Free(posLastGs);
-	Free(scoreLastGp);
-	Free(scoreLastGs);
-	
 	// subtract background score expected without alignment
 	if (normalize) {
 		avgM /= totM;
@@ -644,9 +784,6 @@ SEXP alignProfiles(SEXP p, SEXP s, SEXP type, SEXP subMatrix, SEXP dbnMatrix, SE
 		}
 	}
 	
-	Free(pnorm);
-	Free(snorm);
-	
 	// find the max scoring alignment
 	int maxp = 0;
 	int maxs = 0;
@@ -680,14 +817,7 @@ SEXP alignProfiles(SEXP p, SEXP s, SEXP type, SEXP subMatrix, SEXP dbnMatrix, SE
 	Rprintf("\n");
 	*/
 	
-	Free(m);
-	Free(zip);
-	Free(pstarts);
-	Free(pstops);
-	Free(sstarts);
-	Free(sstops);
-	
-	int *t = Calloc(l, int); // initialized to zero
+	int *t = takeInts(w, l); // initialized to zero
 	
 	i = maxp - 1;
 	j = maxs - 1;
@@ -710,10 +840,10 @@ SEXP alignProfiles(SEXP p, SEXP s, SEXP type, SEXP subMatrix, SEXP dbnMatrix, SE
 	int minp = i + 2;
 	int mins = j + 2;
 	
-	int *p_ins = Calloc(l, int); // initialized to zero
-	int *s_ins = Calloc(l, int); // initialized to zero
-	int *p_ats = Calloc(l, int); // initialized to zero
-	int *s_ats = Calloc(l, int); // initialized to zero
+	int *p_ins = takeInts(w, l); // initialized to zero
+	int *s_ins = takeInts(w, l); // initialized to zero
+	int *p_ats = takeInts(w, l); // initialized to zero
+	int *s_ats = takeInts(w, l); // initialized to zero
 	
 	int p_count, s_count, value;
 	
@@ -773,92 +903,65 @@ SEXP alignProfiles(SEXP p, SEXP s, SEXP type, SEXP subMatrix, SEXP dbnMatrix, SE
 		s_count++;
 	}
 	
-	PROTECT(ans1 = allocVector(INTSXP, p_count));
-	rans = INTEGER(ans1);
-	for (i = 0; i < p_count; i++) {
-		*(rans + i) = p_ats[i];
-	}
-	PROTECT(ans2 = allocVector(INTSXP, p_count));
-	rans = INTEGER(ans2);
-	for (i = 0; i < p_count; i++) {
-		*(rans + i) = p_ins[i];
-	}
-	PROTECT(ans3 = allocVector(INTSXP, s_count));
-	rans = INTEGER(ans3);
-	for (i = 0; i < s_count; i++) {
-		*(rans + i) = s_ats[i];
-	}
-	PROTECT(ans4 = allocVector(INTSXP, s_count));
-	rans = INTEGER(ans4);
-	for (i = 0; i < s_count; i++) {
-		*(rans + i) = s_ins[i];
-	}
-	
-	SEXP ret_list;
-	PROTECT(ret_list = allocVector(VECSXP, 4));
-	SET_VECTOR_ELT(ret_list, 0, ans1);
-	SET_VECTOR_ELT(ret_list, 1, ans2);
-	SET_VECTOR_ELT(ret_list, 2, ans3);
-	SET_VECTOR_ELT(ret_list, 3, ans4);
-	
-	Free(o);
-	Free(t);
-	Free(p_ins);
-	Free(s_ins);
-	Free(p_ats);
-	Free(s_ats);
-	
-	UNPROTECT(5);
-	
-	return ret_list;
+	// copy the gaps out of the workspace
+	g->p_ats = (int *) malloc((2*(p_count + s_count) + 1)*sizeof(int)); // thread-safe on Windows
+	if (g->p_ats == NULL)
+		return 1;
+	g->p_count = p_count;
+	g->s_count = s_count;
+	g->p_ins = g->p_ats + p_count;
+	g->s_ats = g->p_ins + p_count;
+	g->s_ins = g->s_ats + s_count;
+	memcpy(g->p_ats, p_ats, p_count*sizeof(int));
+	memcpy(g->p_ins, p_ins, p_count*sizeof(int));
+	memcpy(g->s_ats, s_ats, s_count*sizeof(int));
+	memcpy(g->s_ins, s_ins, s_count*sizeof(int));
+	
+	return 0;
 }
 
-SEXP alignProfilesAA(SEXP p, SEXP s, SEXP subMatrix, SEXP hecMatrix, SEXP go, SEXP ge, SEXP exp, SEXP power, SEXP endGapPenaltyLeft, SEXP endGapPenaltyRight, SEXP boundary, SEXP norm, SEXP nThreads)
+// aligns two amino acid profiles using the buffers in the workspace,
+// returning zero on success or one if memory could not be allocated
+static int alignAA(const double *pprofile, int lp, const double *sprofile, int ls, const Params *par, int nthreads, Workspace *w, Gaps *g)
 {
-	int i, j, k, pos, start, end, *rans, count, z, totM = 0;
-	double *pprofile, *sprofile, gp, gs, lGp, lGs, M, GP, GS, R, temp, avgM = 0;
+	int i, j, k, pos, start, end, count, z, totM = 0;
+	double gp, gs, lGp, lGs, M, GP, GS, R, temp, avgM = 0;
 	double max, tot, freq;
-	SEXP ans1, ans2, ans3, ans4, dims;
-	
-	pprofile = REAL(p);
-	sprofile = REAL(s);
-	double GO = asReal(go);
-	double GE = asReal(ge);
-	double EX = asReal(exp);
-	double POW1 = REAL(power)[0];
-	double POW2 = REAL(power)[1];
-	double bound = REAL(boundary)[0];
-	double slope = REAL(boundary)[1]*100.4092;
-	double duration = REAL(boundary)[2];
-	double egpL = asReal(endGapPenaltyLeft);
-	double egpR = asReal(endGapPenaltyRight);
-	double *subM = REAL(subMatrix);
-	int normalize = asInteger(norm);
-	int nthreads = asInteger(nThreads);
+	
+	double GO = par->GO;
+	double GE = par->GE;
+	double EX = par->EX;
+	double POW1 = par->POW1;
+	double POW2 = par->POW2;
+	double bound = par->bound;
+	double slope = par->slope;
+	double duration = par->duration;
+	double egpL = par->egpL;
+	double egpR = par->egpR;
+	double *subM = par->subM;
+	int normalize = par->normalize;
 	int NTHREADS = nthreads;
 	
-	double *hecM = REAL(hecMatrix);
-	int do_HEC, d, size = 29;
-	if (length(hecMatrix) > 0) {
-		do_HEC = 1;
-		PROTECT(dims = GET_DIM(hecMatrix));
-		d = INTEGER(dims)[0];
-		UNPROTECT(1);
-		size += d;
-	} else {
-		do_HEC = 0;
-		d = 0;
-	}
+	double *hecM = par->structM;
+	int d = par->d;
+	int do_HEC = d > 0;
+	int size = 29 + d;
 	
-	R_len_t lp = length(p)/size;
-	R_len_t ls = length(s)/size;
 	int l = lp + ls;
+	g->p_count = 0;
+	g->s_count = 0;
+	g->p_ats = NULL;
+	if (reserveWorkspace(w,
+		(size_t)(lp + 1)*(ls + 1) + l, // m and scoreLastG*
+		(size_t)lp*ls + 26*(size_t)l, // o, posLastG*, t, gaps, and residue orders
+		6*(size_t)l + (lp > ls ? lp : ls) + 1)) // norms, starts, stops, gap modulation, and zip
+		return 1;
 	
 	int N21[20] = {0, 21, 42, 63, 84, 105, 126, 147, 168, 189, 210, 231, 252, 273, 294, 315, 336, 357, 378, 399};
 	
 	// initialize arrays of residue orders
-	int *Op = Calloc(lp*20, int); // initialized to zero
-	int *Os = Calloc(ls*20, int); // initialized to zero
+	int *Op = takeInts(w, lp*20); // initialized to zero
+	int *Os = takeInts(w, ls*20); // initialized to zero
 	int SIZE20, ISIZE;
 	
 	for (i = 0; i < lp; i++) {
@@ -926,14 +1029,14 @@ SEXP alignProfilesAA(SEXP p, SEXP s, SEXP subMatrix, SEXP hecMatrix, SEXP go, SE
 	};
 	
 	// gap extension based on residues opposing the gap
-	double *GCp = Calloc(lp, double); // initialized to zero
-	double *GCs = Calloc(ls, double); // initialized to zero
+	double *GCp = takeDoubles(w, lp); // initialized to zero
+	double *GCs = takeDoubles(w, ls); // initialized to zero
 	// gap opening based on local sequence context
-	double *GOp = Calloc(lp, double); // initialized to zero
-	double *GOs = Calloc(ls, double); // initialized to zero
+	double *GOp = takeDoubles(w, lp); // initialized to zero
+	double *GOs = takeDoubles(w, ls); // initialized to zero
 	// gap opening in the opposing sequence based on runs
-	double *GRp = Calloc(lp, double); // initialized to zero
-	double *GRs = Calloc(ls, double); // initialized to zero
+	double *GRp = takeDoubles(w, lp); // initialized to zero
+	double *GRs = takeDoubles(w, ls); // initialized to zero
 	
 	// start of run of length 2 at position zero
 	//          -2          -1            0           +1
@@ -1040,14 +1143,14 @@ SEXP alignProfilesAA(SEXP p, SEXP s, SEXP subMatrix, SEXP hecMatrix, SEXP go, SE
 		}
 	}
 	
-	float *m = Calloc((lp+1)*(ls+1), float); // initialized to zero
-	int *o = Calloc(lp*ls, int); // initialized to zero
+	float *m = takeFloats(w, (lp+1)*(ls+1)); // initialized to zero
+	int *o = takeInts(w, lp*ls); // initialized to zero
 	
 	// initialize arrays for recording the last gap that existed
-	float *scoreLastGp = Calloc(lp, float); // initialized to zero
-	float *scoreLastGs = Calloc(ls, float); // initialized to zero
-	int *posLastGp = Calloc(lp, int); // initialized to zero
-	int *posLastGs = Calloc(ls, int); // initialized to zero
+	float *scoreLastGp = takeFloats(w, lp); // initialized to zero
+	float *scoreLastGs = takeFloats(w, ls); // initialized to zero
+	int *posLastGp = takeInts(w, lp); // initialized to zero
+	int *posLastGs = takeInts(w, ls); // initialized to zero
 	
 	// zipfian distribution for gap cost
 	if (lp > ls) {
@@ -1055,15 +1158,15 @@ SEXP alignProfilesAA(SEXP p, SEXP s, SEXP subMatrix, SEXP hecMatrix, SEXP go, SE
 	} else {
 		j = ls;
 	}
-	double *zip = Calloc(j + 1, double); // initialized to zero
+	double *zip = takeDoubles(w, j + 1); // initialized to zero
 	for (i = 1; i <= j; i++)
 		zip[i] = pow((double)i, EX);
 	
 	// deterine the fraction of sequences starting or ending
-	double *pstarts = Calloc(lp, double); // initialized to zero
-	double *pstops = Calloc(lp, double); // initialized to zero
-	double *sstarts = Calloc(ls, double); // initialized to zero
-	double *sstops = Calloc(ls, double); // initialized to zero
+	double *pstarts = takeDoubles(w, lp); // initialized to zero
+	double *pstops = takeDoubles(w, lp); // initialized to zero
+	double *sstarts = takeDoubles(w, ls); // initialized to zero
+	double *sstops = takeDoubles(w, ls); // initialized to zero
 	double past, current;
 	past = 0;
 	for (i = 0; i < lp; i++) {
@@ -1115,8 +1218,8 @@ SEXP alignProfilesAA(SEXP p, SEXP s, SEXP subMatrix, SEXP hecMatrix, SEXP go, SE
 	}
 	
 	// create array of normalization factors (coverge^POW)
-	double *pnorm = Calloc(lp, double); // initialized to zero
-	double *snorm = Calloc(ls, double); // initialized to zero
+	double *pnorm = takeDoubles(w, lp); // initialized to zero
+	double *snorm = takeDoubles(w, ls); // initialized to zero
 	for (i = 0; i < lp; i++)
 		if (pprofile[26 + size*i] > 0)
 			pnorm[i] = pow(pprofile[26 + size*i], POW1)*pow(1 - pprofile[23 + size*i], POW2);
@@ -1463,11 +1566,6 @@ SEXP alignProfilesAA(SEXP p, SEXP s, SEXP subMatrix, SEXP hecMatrix, SEXP go, SE
 		}
 	}
 	
-	Free(posLastGp);
-	Free(posLastGs);
-	Free(scoreLastGp);
-	Free(scoreLastGs);
-	
 	// subtract background score expected without alignment
 	if (normalize) {
 		avgM /= totM;
@@ -1482,9 +1580,6 @@ SEXP alignProfilesAA(SEXP p, SEXP s, SEXP subMatrix, SEXP hecMatrix, SEXP go, SE
 		}
 	}
 	
-	Free(pnorm);
-	Free(snorm);
-	
 	// find the max scoring alignment
 	int maxp = 0;
 	int maxs = 0;
@@ -1518,22 +1613,7 @@ SEXP alignProfilesAA(SEXP p, SEXP s, SEXP subMatrix, SEXP hecMatrix, SEXP go, SE
 	Rprintf("\n");
 	*/
 	
-	Free(m);
-	Free(Op);
-	Free(Os);
-	Free(zip);
-	Free(GCp);
-	Free(GCs);
-	Free(GOp);
-	Free(GOs);
-	Free(GRp);
-	Free(GRs);
-	Free(pstarts);
-	Free(pstops);
-	Free(sstarts);
-	Free(sstops);
-	
-	int *t = Calloc(l, int); // initialized to zero
+	int *t = takeInts(w, l); // initialized to zero
 	
 	i = maxp - 1;
 	j = maxs - 1;
@@ -1556,10 +1636,10 @@ SEXP alignProfilesAA(SEXP p, SEXP s, SEXP subMatrix, SEXP hecMatrix, SEXP go, SE
 	int minp = i + 2;
 	int mins = j + 2;
 	
-	int *p_ins = Calloc(l, int); // initialized to zero
-	int *s_ins = Calloc(l, int); // initialized to zero
-	int *p_ats = Calloc(l, int); // initialized to zero
-	int *s_ats = Calloc(l, int); // initialized to zero
+	int *p_ins = takeInts(w, l); // initialized to zero
+	int *s_ins = takeInts(w, l); // initialized to zero
+	int *p_ats = takeInts(w, l); // initialized to zero
+	int *s_ats = takeInts(w, l); // initialized to zero
 	
 	int p_count, s_count, value;
 	
@@ -1619,42 +1699,160 @@ SEXP alignProfilesAA(SEXP p, SEXP s, SEXP subMatrix, SEXP hecMatrix, SEXP go, SE
 		s_count++;
 	}
 	
-	PROTECT(ans1 = allocVector(INTSXP, p_count));
-	rans = INTEGER(ans1);
-	for (i = 0; i < p_count; i++) {
-		*(rans + i) = p_ats[i];
-	}
-	PROTECT(ans2 = allocVector(INTSXP, p_count));
-	rans = INTEGER(ans2);
-	for (i = 0; i < p_count; i++) {
-		*(rans + i) = p_ins[i];
+	// copy the gaps out of the workspace
+	g->p_ats = (int *) malloc((2*(p_count + s_count) + 1)*sizeof(int)); // thread-safe on Windows
+	if (g->p_ats == NULL)
+		return 1;
+	g->p_count = p_count;
+	g->s_count = s_count;
+	g->p_ins = g->p_ats + p_count;
+	g->s_ats = g->p_ins + p_count;
+	g->s_ins = g->s_ats + s_count;
+	memcpy(g->p_ats, p_ats, p_count*sizeof(int));
+	memcpy(g->p_ins, p_ins, p_count*sizeof(int));
+	memcpy(g->s_ats, s_ats, s_count*sizeof(int));
+	memcpy(g->s_ins, s_ins, s_count*sizeof(int));
+	
+	return 0;
+}
+
+SEXP alignProfiles(SEXP p, SEXP s, SEXP type, SEXP subMatrix, SEXP dbnMatrix, SEXP pm, SEXP mm, SEXP go, SEXP ge, SEXP exp, SEXP power, SEXP endGapPenaltyLeft, SEXP endGapPenaltyRight, SEXP boundary, SEXP norm, SEXP nThreads)
+{
+	Params par;
+	Workspace w = {0};
+	Gaps g;
+	StageTimer timer = startStage();
+	
+	getParams(&par, subMatrix, dbnMatrix, pm, mm, go, ge, exp, power, endGapPenaltyLeft, endGapPenaltyRight, boundary, norm);
+	int size = 8 + par.d;
+	R_len_t lp = length(p)/size;
+	R_len_t ls = length(s)/size;
+	
+	int failed = alignDNA(REAL(p), lp, REAL(s), ls, &par, asInteger(nThreads), &w, &g);
+	freeWorkspace(&w);
+	if (failed)
+		error("Out of memory");
+	
+	COUNT(COUNT_DP_CELLS, (double)lp*ls);
+	stopStage(STAGE_ALIGN_PROFILES, timer);
+	
+	return gapsAsList(&g);
+}
+
+SEXP alignProfilesAA(SEXP p, SEXP s, SEXP subMatrix, SEXP hecMatrix, SEXP go, SEXP ge, SEXP exp, SEXP power, SEXP endGapPenaltyLeft, SEXP endGapPenaltyRight, SEXP boundary, SEXP norm, SEXP nThreads)
+{
+	Params par;
+	Workspace w = {0};
+	Gaps g;
+	
+	getParams(&par, subMatrix, hecMatrix, R_NilValue, R_NilValue, go, ge, exp, power, endGapPenaltyLeft, endGapPenaltyRight, boundary, norm);
+	int size = 29 + par.d;
+	R_len_t lp = length(p)/size;
+	R_len_t ls = length(s)/size;
+	
+	int failed = alignAA(REAL(p), lp, REAL(s), ls, &par, asInteger(nThreads), &w, &g);
+	freeWorkspace(&w);
+	if (failed)
+		error("Out of memory");
+	
+	return gapsAsList(&g);
+}
+
+// align many pairs of profiles (p[[i]] with s[[i]]) sharing the same parameters
+// except the terminal gaps, which are given once or once per pair
+SEXP alignProfilesBatch(SEXP p, SEXP s, SEXP type, SEXP subMatrix, SEXP structMatrix, SEXP pm, SEXP mm, SEXP go, SEXP ge, SEXP exp, SEXP power, SEXP endGapPenaltyLeft, SEXP endGapPenaltyRight, SEXP boundary, SEXP norm, SEXP nThreads)
+{
+	int i;
+	Params par;
+	StageTimer timer = startStage();
+	
+	int AA = asInteger(type) == 3;
+	int nthreads = asInteger(nThreads);
+	int n = length(p);
+	if (length(s) != n)
+		error("p and s must be lists of the same length.");
+	int nL = length(endGapPenaltyLeft);
+	int nR = length(endGapPenaltyRight);
+	if ((nL != 1 && nL != n) || (nR != 1 && nR != n))
+		error("Terminal gaps must be of length 1 or the number of alignments.");
+	double *egpL = REAL(endGapPenaltyLeft);
+	double *egpR = REAL(endGapPenaltyRight);
+	
+	getParams(&par, subMatrix, structMatrix, pm, mm, go, ge, exp, power, endGapPenaltyLeft, endGapPenaltyRight, boundary, norm);
+	int size = (AA ? 29 : 8) + par.d;
+	
+	const double **pprofiles = Calloc(n, const double *);
+	const double **sprofiles = Calloc(n, const double *);
+	int *lp = Calloc(n, int);
+	int *ls = Calloc(n, int);
+	double cells = 0;
+	for (i = 0; i < n; i++) {
+		pprofiles[i] = REAL(VECTOR_ELT(p, i));
+		sprofiles[i] = REAL(VECTOR_ELT(s, i));
+		lp[i] = length(VECTOR_ELT(p, i))/size;
+		ls[i] = length(VECTOR_ELT(s, i))/size;
+		cells += (double)lp[i]*ls[i];
 	}
-	PROTECT(ans3 = allocVector(INTSXP, s_count));
-	rans = INTEGER(ans3);
-	for (i = 0; i < s_count; i++) {
-		*(rans + i) = s_ats[i];
+	Gaps *g = Calloc(n, Gaps);
+	
+	// parallelize across alignments unless there is only one
+	int outer = (n > 1) ? nthreads : 1;
+	int inner = (n > 1) ? 1 : nthreads;
+	
+	int failed = 0; // whether any alignment ran out of memory
+	#ifdef _OPENMP
+	#pragma omp parallel num_threads(outer)
+	#endif
+	{
+		Workspace w = {0}; // reused by every alignment on this thread
+		
+		#ifdef _OPENMP
+		#pragma omp for schedule(dynamic)
+		#endif
+		for (i = 0; i < n; i++) {
+			if (failed) { // skip remaining alignments
+				g[i].p_ats = NULL;
+				continue;
+			}
+			Params q = par;
+			q.egpL = egpL[nL == 1 ? 0 : i];
+			q.egpR = egpR[nR == 1 ? 0 : i];
+			
+			int f;
+			if (AA) {
+				f = alignAA(pprofiles[i], lp[i], sprofiles[i], ls[i], &q, inner, &w, g + i);
+			} else {
+				f = alignDNA(pprofiles[i], lp[i], sprofiles[i], ls[i], &q, inner, &w, g + i);
+			}
+			if (f)
+				failed = 1;
+		}
+		
+		freeWorkspace(&w);
 	}
-	PROTECT(ans4 = allocVector(INTSXP, s_count));
-	rans = INTEGER(ans4);
-	for (i = 0; i < s_count; i++) {
-		*(rans + i) = s_ins[i];
+	
+	Free(pprofiles);
+	Free(sprofiles);
+	Free(lp);
+	Free(ls);
+	
+	if (failed) {
+		for (i = 0; i < n; i++)
+			free(g[i].p_ats);
+		Free(g);
+		error("Out of memory");
 	}
 	
-	SEXP ret_list;
-	PROTECT(ret_list = allocVector(VECSXP, 4));
-	SET_VECTOR_ELT(ret_list, 0, ans1);
-	SET_VECTOR_ELT(ret_list, 1, ans2);
-	SET_VECTOR_ELT(ret_list, 2, ans3);
-	SET_VECTOR_ELT(ret_list, 3, ans4);
+	SEXP ans;
+	PROTECT(ans = allocVector(VECSXP, n));
+	for (i = 0; i < n; i++)
+		SET_VECTOR_ELT(ans, i, gapsAsList(g + i));
+	Free(g);
 	
-	Free(o);
-	Free(t);
-	Free(p_ins);
-	Free(s_ins);
-	Free(p_ats);
-	Free(s_ats);
+	UNPROTECT(1);
 	
-	UNPROTECT(5);
+	COUNT(COUNT_DP_CELLS, cells);
+	stopStage(STAGE_ALIGN_PROFILES, timer);
 	
-	return ret_list;
+	return ans;
 }
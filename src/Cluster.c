@@ -249,6 +249,7 @@ SEXP cluster(SEXP x, SEXP cutoff, SEXP method, SEXP l, SEXP verbose, SEXP pBar,
 	double soFar, total, minHeight, *cut, *rans, *distanceMatrix, minH;
 	SEXP ans, percentComplete, utilsPackage;
 	int nthreads = asInteger(nThreads);
+	StageTimer timer = startStage();
 	
 	// initialize variables
 	clusterNum = 0; // increments with each new cluster
@@ -976,6 +977,9 @@ SEXP cluster(SEXP x, SEXP cutoff, SEXP method, SEXP l, SEXP verbose, SEXP pBar,
 		UNPROTECT(1);
 	}
 	
+	COUNT(COUNT_MERGES, length - 1);
+	stopStage(STAGE_CLUSTER, timer);
+	
 	return ans;
 }
 
@@ -1141,6 +1141,7 @@ SEXP clusterML(SEXP x, SEXP y, SEXP model, SEXP branches, SEXP lengths, SEXP sta
 	const int s2 = s1*s1;
 	int *W = INTEGER(weights);
 	int nthreads = asInteger(nThreads);
+	StageTimer timer = startStage();
 	
 	SEXP dims;
 	PROTECT(dims = GET_DIM(x));
@@ -1790,6 +1791,9 @@ SEXP clusterML(SEXP x, SEXP y, SEXP model, SEXP branches, SEXP lengths, SEXP sta
 	Free(sumL);
 	UNPROTECT(1);
 	
+	COUNT(COUNT_LIKELIHOODS, altB + 1);
+	stopStage(STAGE_CLUSTER_ML, timer);
+	
 	return ans;
 }
 
@@ -2398,3 +2398,264 @@ SEXP decompress(SEXP x, SEXP nThreads)
 	
 	return seqs;
 }
+
+////////////////////////////////////////////////////
+// per-sequence statistics recorded upon import
+////////////////////////////////////////////////////
+
+// 128-bit hash (MurmurHash3_x64_128) with bytes read in
+// little-endian order for platform-independence
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	
+	return k;
+}
+
+static void hash128(const char *s, int len, uint64_t seed, uint64_t *out)
+{
+	const unsigned char *d = (const unsigned char *)s;
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	uint64_t h1 = seed, h2 = seed;
+	uint64_t k1, k2;
+	int i, j, n = len/16;
+	
+	for (i = 0; i < n; i++, d += 16) {
+		k1 = 0;
+		k2 = 0;
+		for (j = 7; j >= 0; j--) {
+			k1 = (k1 << 8) | d[j];
+			k2 = (k2 << 8) | d[j + 8];
+		}
+		
+		k1 *= c1;
+		k1 = rotl64(k1, 31);
+		k1 *= c2;
+		h1 ^= k1;
+		h1 = rotl64(h1, 27);
+		h1 += h2;
+		h1 = h1*5 + 0x52dce729;
+		
+		k2 *= c2;
+		k2 = rotl64(k2, 33);
+		k2 *= c1;
+		h2 ^= k2;
+		h2 = rotl64(h2, 31);
+		h2 += h1;
+		h2 = h2*5 + 0x38495ab5;
+	}
+	
+	k1 = 0;
+	k2 = 0;
+	switch (len & 15) {
+		case 15: k2 ^= (uint64_t)d[14] << 48;
+		case 14: k2 ^= (uint64_t)d[13] << 40;
+		case 13: k2 ^= (uint64_t)d[12] << 32;
+		case 12: k2 ^= (uint64_t)d[11] << 24;
+		case 11: k2 ^= (uint64_t)d[10] << 16;
+		case 10: k2 ^= (uint64_t)d[9] << 8;
+		case 9: k2 ^= (uint64_t)d[8];
+			k2 *= c2;
+			k2 = rotl64(k2, 33);
+			k2 *= c1;
+			h2 ^= k2;
+		case 8: k1 ^= (uint64_t)d[7] << 56;
+		case 7: k1 ^= (uint64_t)d[6] << 48;
+		case 6: k1 ^= (uint64_t)d[5] << 40;
+		case 5: k1 ^= (uint64_t)d[4] << 32;
+		case 4: k1 ^= (uint64_t)d[3] << 24;
+		case 3: k1 ^= (uint64_t)d[2] << 16;
+		case 2: k1 ^= (uint64_t)d[1] << 8;
+		case 1: k1 ^= (uint64_t)d[0];
+			k1 *= c1;
+			k1 = rotl64(k1, 31);
+			k1 *= c2;
+			h1 ^= k1;
+	}
+	
+	h1 ^= (uint64_t)len;
+	h2 ^= (uint64_t)len;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+	
+	out[0] = h1;
+	out[1] = h2;
+}
+
+// width, ungapped width, unambiguous and ambiguous
+// nucleotides, GC content, content hash, and alphabet of each string
+// (type is 1 for DNA, 2 for RNA, 3 for neither, or 0 to infer)
+SEXP seqStats(SEXP x, SEXP type, SEXP nThreads)
+{
+	int i, j;
+	int n = length(x);
+	int t = asInteger(type);
+	int nthreads = asInteger(nThreads);
+	const char hex[] = "0123456789abcdef";
+	
+	SEXP ans, width, ungapped, bases, ambiguities, gc, hash, alphabet;
+	PROTECT(ans = allocVector(VECSXP, 7));
+	PROTECT(width = allocVector(INTSXP, n));
+	PROTECT(ungapped = allocVector(INTSXP, n));
+	PROTECT(bases = allocVector(INTSXP, n));
+	PROTECT(ambiguities = allocVector(INTSXP, n));
+	PROTECT(gc = allocVector(REALSXP, n));
+	int *w = INTEGER(width);
+	int *u = INTEGER(ungapped);
+	int *b = INTEGER(bases);
+	int *a = INTEGER(ambiguities);
+	double *g = REAL(gc);
+	
+	const char **strs = Calloc(n, const char *); // uncompressed strings
+	char *h = Calloc(n*32, char); // hexadecimal hashes
+	int *types = Calloc(n, int); // sequence type used for the statistics
+	
+	// build a vector of thread-safe pointers
+	for (i = 0; i < n; i++) {
+		strs[i] = CHAR(STRING_ELT(x, i));
+		w[i] = length(STRING_ELT(x, i));
+	}
+	
+	#ifdef _OPENMP
+	#pragma omp parallel for private(i,j) schedule(guided) num_threads(nthreads)
+	#endif
+	for (i = 0; i < n; i++) {
+		const char *s = strs[i];
+		int gaps = 0, std = 0, T = 0, U = 0, amb = 0, GC = 0, other = 0;
+		
+		for (j = 0; j < w[i]; j++) {
+			switch (s[j]) {
+				case '-':
+				case '.':
+					gaps++;
+					break;
+				case 'C':
+				case 'c':
+				case 'G':
+				case 'g':
+					GC++;
+				case 'A':
+				case 'a':
+					std++;
+					break;
+				case 'T':
+				case 't':
+					T++;
+					break;
+				case 'U':
+				case 'u':
+					U++;
+					break;
+				case 'M':
+				case 'm':
+				case 'R':
+				case 'r':
+				case 'W':
+				case 'w':
+				case 'S':
+				case 's':
+				case 'Y':
+				case 'y':
+				case 'K':
+				case 'k':
+				case 'V':
+				case 'v':
+				case 'H':
+				case 'h':
+				case 'D':
+				case 'd':
+				case 'B':
+				case 'b':
+				case 'N':
+				case 'n':
+					amb++;
+					break;
+				case '+': // mask
+					break;
+				default:
+					other++;
+					break;
+			}
+		}
+		
+		int st = t; // sequence type
+		if (st == 0) { // infer from the characters
+			if (other > 0) {
+				st = 3; // not nucleotides
+			} else if (U > 0 && T == 0) {
+				st = 2; // RNA
+			} else {
+				st = 1; // DNA
+			}
+		}
+		
+		types[i] = st;
+		u[i] = w[i] - gaps;
+		if (st == 3) { // statistics only apply to nucleotides
+			b[i] = NA_INTEGER;
+			a[i] = NA_INTEGER;
+			g[i] = NA_REAL;
+		} else {
+			std += (st == 1) ? T : U;
+			b[i] = std;
+			a[i] = amb;
+			g[i] = (std > 0) ? (double)GC/(double)std : NA_REAL;
+		}
+		
+		uint64_t k[2];
+		hash128(s, w[i], 0, k);
+		for (j = 15; j >= 0; j--) {
+			h[i*32 + j] = hex[k[0] & 0xF];
+			h[i*32 + j + 16] = hex[k[1] & 0xF];
+			k[0] >>= 4;
+			k[1] >>= 4;
+		}
+	}
+	
+	PROTECT(hash = allocVector(STRSXP, n));
+	for (i = 0; i < n; i++)
+		SET_STRING_ELT(hash, i, mkCharLen(h + i*32, 32));
+	
+	PROTECT(alphabet = allocVector(STRSXP, n));
+	for (i = 0; i < n; i++) {
+		if (types[i] == 1) {
+			SET_STRING_ELT(alphabet, i, mkChar("DNA"));
+		} else if (types[i] == 2) {
+			SET_STRING_ELT(alphabet, i, mkChar("RNA"));
+		} else if (t == 3) {
+			SET_STRING_ELT(alphabet, i, mkChar("AA"));
+		} else { // inferred to be neither
+			SET_STRING_ELT(alphabet, i, NA_STRING);
+		}
+	}
+	
+	Free(strs);
+	Free(h);
+	Free(types);
+	
+	SET_VECTOR_ELT(ans, 0, width);
+	SET_VECTOR_ELT(ans, 1, ungapped);
+	SET_VECTOR_ELT(ans, 2, bases);
+	SET_VECTOR_ELT(ans, 3, ambiguities);
+	SET_VECTOR_ELT(ans, 4, gc);
+	SET_VECTOR_ELT(ans, 5, hash);
+	SET_VECTOR_ELT(ans, 6, alphabet);
+	
+	UNPROTECT(8);
+	
+	return ans;
+}
@@ -51,7 +51,7 @@ SEXP computeOverlap(SEXP x, SEXP y, SEXP v, SEXP wordSize, SEXP mult, SEXP entro
 
 SEXP overlap(SEXP res, SEXP widths1, SEXP widths2);
 
-SEXP cophenetic(SEXP Index1, SEXP N, SEXP D, SEXP H);
+SEXP cophenetic(SEXP x, SEXP y, SEXP nThreads);
 
 // Cluster.c
 
@@ -91,6 +91,8 @@ SEXP intMatch(SEXP x, SEXP y);
 
 SEXP matchOrder(SEXP x, SEXP verbose, SEXP pBar, SEXP nThreads);
 
+SEXP matchOrderSeeds(SEXP x, SEXP seeds, SEXP verbose, SEXP pBar, SEXP nThreads);
+
 SEXP matchRanges(SEXP x, SEXP y, SEXP wordSize, SEXP maxLength, SEXP threshold);
 
 SEXP boundedMatches(SEXP x, SEXP bl, SEXP bu);
@@ -119,7 +121,7 @@ SEXP detectCores();
 
 // ReplaceChars.c
 
-SEXP replaceChars(SEXP x, SEXP r, SEXP t);
+SEXP replaceChars(SEXP x, SEXP r, SEXP t, SEXP nThreads);
 
 SEXP replaceChar(SEXP x, SEXP c, SEXP r);
 
@@ -151,6 +153,8 @@ SEXP alignProfiles(SEXP p, SEXP s, SEXP type, SEXP subMatrix, SEXP dbnMatrix, SE
 
 SEXP alignProfilesAA(SEXP p, SEXP s, SEXP subMatrix, SEXP hecMatrix, SEXP go, SEXP ge, SEXP exp, SEXP power, SEXP endGapPenaltyLeft, SEXP endGapPenaltyRight, SEXP boundary, SEXP norm, SEXP nThreads);
 
+SEXP alignProfilesBatch(SEXP p, SEXP s, SEXP type, SEXP subMatrix, SEXP structMatrix, SEXP pm, SEXP mm, SEXP go, SEXP ge, SEXP exp, SEXP power, SEXP endGapPenaltyLeft, SEXP endGapPenaltyRight, SEXP boundary, SEXP norm, SEXP nThreads);
+
 // EnumerateSequence.c
 
 SEXP enumerateSequence(SEXP x, SEXP wordSize, SEXP mask, SEXP maskLCRs, SEXP maskNum, SEXP fastMovingSide, SEXP nThreads);
@@ -251,14 +255,12 @@ SEXP qbit(SEXP x, SEXP y, SEXP nThreads);
 
 SEXP decompress(SEXP x, SEXP nThreads);
 
+SEXP seqStats(SEXP x, SEXP type, SEXP nThreads);
+
 // Diff.c
 
 SEXP intDiff(SEXP x);
 
-// MovingAverage.c
-
-SEXP movAvg(SEXP x, SEXP type, SEXP alpha, SEXP thresh, SEXP maxAvg, SEXP start, SEXP end);
-
 // GetPools.c
 
 SEXP getPools(SEXP x);
@@ -273,6 +275,8 @@ SEXP informationContent(SEXP p, SEXP nS, SEXP correction, SEXP randomBackground)
 
 SEXP informationContentAA(SEXP p, SEXP nS, SEXP correction, SEXP randomBackground);
 
+SEXP maskColumns(SEXP ic, SEXP gapFrac, SEXP maxGaps, SEXP windowSize, SEXP threshold, SEXP extend);
+
 // VectorSums.c
 
 SEXP vectorSum(SEXP x, SEXP y, SEXP z, SEXP b);
@@ -337,7 +341,9 @@ SEXP getBounds(SEXP widths, SEXP start, SEXP end, SEXP minL, SEXP maxL, SEXP len
 
 SEXP addIfElse(SEXP vec, SEXP index, SEXP scores);
 
-SEXP kmerScores(SEXP oligos, SEXP ints, SEXP windowSize, SEXP kSize);
+SEXP kmerBackground(SEXP ints, SEXP windowSize);
+
+SEXP kmerScores(SEXP oligos, SEXP ints, SEXP background, SEXP kSize, SEXP nThreads);
 
 SEXP getHits(SEXP starts, SEXP ends, SEXP left1, SEXP left2, SEXP right1, SEXP right2, SEXP deltaG);
 
@@ -347,7 +353,8 @@ SEXP scoreCouplingModel(SEXP x, SEXP orftable, SEXP coupling_scores, SEXP aatabl
 
 SEXP maxPerORF(SEXP orftable, SEXP scores);
 
-SEXP scorePWM(SEXP pwm, SEXP x, SEXP minScore, SEXP nThreads);
+
+SEXP scorePWMs(SEXP pwms, SEXP x, SEXP minScores, SEXP nThreads);
 
 SEXP scoreTopPWM(SEXP pwm, SEXP x, SEXP begin, SEXP positions, SEXP nThreads);
 
@@ -361,14 +368,91 @@ SEXP clusterMP(SEXP x, SEXP z, SEXP s, SEXP sizes, SEXP scoreOnly, SEXP add, SEX
 
 SEXP alignPair(SEXP x, SEXP y, SEXP s1, SEXP e1, SEXP s2, SEXP e2, SEXP go, SEXP ge, SEXP tg, SEXP maxLength, SEXP type, SEXP subMatrix, SEXP nThreads);
 
-SEXP alignPairs(SEXP pattern, SEXP subject, SEXP query, SEXP target, SEXP position, SEXP bandWidth, SEXP gapOpening, SEXP gapExtension, SEXP dropScore, SEXP subMatrix, SEXP matchMatrix, SEXP letters, SEXP verbose, SEXP pBar, SEXP nThreads);
+SEXP alignPairs(SEXP pattern, SEXP subject, SEXP query, SEXP target, SEXP position, SEXP bandWidth, SEXP adaptiveBand, SEXP gapOpening, SEXP gapExtension, SEXP dropScore, SEXP subMatrix, SEXP matchMatrix, SEXP letters, SEXP verbose, SEXP pBar, SEXP nThreads);
+
+// pair of sequences aligned between anchors
+typedef struct {
+	int start1, end1, start2, end2; // aligned range of pattern and subject
+	int matches, mismatches, length;
+	double score;
+	int count1, count2; // number of gaps in pattern and subject
+	int *indels1, *lengths1, *indels2, *lengths2;
+	double cells; // number of scored positions
+	int expansions; // number of times the band widened
+} PairAlignment;
+
+int alignAnchoredPairs(int n, const char **p, const int *pl, const char **s, const int *sl, int **anchors, const int *N, const int *index1, const int *index2, int first, int bandWidth, int adaptive, double GO, double GE, double dropScore, double *subMatrix, int *matchMatrix, int *lkup_row, int *lkup_col, PairAlignment *a, int *err);
+
+SEXP pairAlignmentsAsList(PairAlignment *a, int l);
 
 // Search.c
 
-SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP count, SEXP location, SEXP index, SEXP positions, SEXP sepC, SEXP gapC, SEXP total, SEXP minScore, SEXP scoreOnly, SEXP pattern, SEXP subject, SEXP subMatrix, SEXP letters, SEXP dropScore, SEXP limitTarget, SEXP limitQuery, SEXP verbose, SEXP pBar, SEXP nThreads);
+SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP count, SEXP location, SEXP index, SEXP positions, SEXP sepC, SEXP gapC, SEXP total, SEXP minScore, SEXP scoreOnly, SEXP pattern, SEXP subject, SEXP subMatrix, SEXP letters, SEXP dropScore, SEXP limitTarget, SEXP limitQuery, SEXP align, SEXP compact, SEXP bySubject, SEXP verbose, SEXP pBar, SEXP nThreads);
 
 SEXP countIndex(SEXP num, SEXP query, SEXP step);
 
 SEXP updateIndex(SEXP offset, SEXP query, SEXP wordSize, SEXP step, SEXP location, SEXP index, SEXP positions, SEXP count);
 
 SEXP approxFreqs(SEXP offset, SEXP freqs, SEXP count);
+
+// Newick.c
+
+SEXP parseNewick(SEXP x, SEXP quoteChar, SEXP convertBlanks, SEXP internalLabels);
+
+SEXP writeNewick(SEXP x, SEXP quoteChar, SEXP spaceChar, SEXP internalLabels, SEXP digits, SEXP sigDigits);
+
+// TrimDNA.c
+
+SEXP trimDNA(SEXP x, SEXP leftPatterns, SEXP rightPatterns, SEXP maxDistance, SEXP minOverlap, SEXP allowInternal, SEXP quality, SEXP type, SEXP alpha, SEXP thresh, SEXP maxAvg, SEXP nThreads);
+
+// MatchPatterns.c
+
+SEXP matchPatterns(SEXP x, SEXP patterns, SEXP maxDist, SEXP withIndels, SEXP nThreads);
+
+// Instrument.c
+
+enum {STAGE_ALIGN_PROFILES, STAGE_ALIGN_PAIRS, STAGE_SEARCH_INDEX, STAGE_DIST_MATRIX, STAGE_CLUSTER, STAGE_CLUSTER_ML, NUM_STAGES};
+
+enum {COUNT_DP_CELLS, COUNT_KMER_HITS, COUNT_DISTANCES, COUNT_MERGES, COUNT_LIKELIHOODS, COUNT_BAND_EXPANSIONS, NUM_COUNTERS};
+
+typedef struct {
+	double wall, cpu;
+	int threadCPU; // whether cpu is for the calling thread only
+} StageTimer;
+
+extern int instrumentOn;
+
+StageTimer startStage();
+
+void stopStage(int stage, StageTimer t);
+
+void addCount(int counter, double n);
+
+// near zero cost when instrumentation is off
+#define COUNT(counter, n) do { if (instrumentOn) addCount(counter, n); } while (0)
+
+SEXP setInstrument(SEXP enable, SEXP sample, SEXP reset);
+
+SEXP getInstrument(SEXP file);
+
+// Progress.c
+
+typedef struct {
+	double total; // units of work
+	double done; // units of work completed by all threads
+	int before; // percent last shown
+	int interrupted; // set when the user interrupts
+	int verbose;
+	double last; // wall time of the last poll
+	SEXP pBar, percentComplete, utilsPackage;
+} Progress;
+
+void initProgress(Progress *p, double total, int verbose, SEXP pBar);
+
+void addProgress(Progress *p, double n);
+
+int progressInterrupted(Progress *p);
+
+int pollProgress(Progress *p);
+
+int finishProgress(Progress *p);
@@ -30,6 +30,9 @@
 // for calloc/free
 #include <stdlib.h>
 
+// for INT_MAX
+#include <limits.h>
+
 /*
  * Biostrings_interface.h is needed for the DNAencode(), get_XString_asRoSeq(),
  * init_match_reporting(), report_match() and reported_matches_asSEXP()
@@ -314,9 +317,10 @@ SEXP distMatrix(SEXP x, SEXP t, SEXP terminalGaps, SEXP penalizeGapLetters, SEXP
 	double E = asReal(e);
 	R_xlen_t x_length, i, j, last;
 	int pGapLetters, tGaps, fM = asLogical(fullMatrix);
-	int before, v, *rPercentComplete;
-	double *rans, soFar;
+	int v;
+	double *rans;
 	int nthreads = asInteger(nThreads);
+	StageTimer timer = startStage();
 	int o = asInteger(output);
 	double coverage = asReal(minCoverage);
 	if (coverage >= 0) {
@@ -326,16 +330,8 @@ SEXP distMatrix(SEXP x, SEXP t, SEXP terminalGaps, SEXP penalizeGapLetters, SEXP
 		coverage *= -1;
 	}
 	int mode = asInteger(method);
-	SEXP ans, percentComplete, utilsPackage;
+	SEXP ans;
 	v = asLogical(verbose);
-	if (v) { // percent complete variables
-		soFar = 0;
-		before = 0;
-		PROTECT(percentComplete = NEW_INTEGER(1));
-		rPercentComplete = INTEGER(percentComplete);
-		// make it possible to access R functions from the utils package for the progress bar
-		PROTECT(utilsPackage = eval(lang2(install("getNamespace"), ScalarString(mkChar("utils"))), R_GlobalEnv));
-	}
 	
 	x_set = hold_XStringSet(x);
 	x_length = get_length_from_XStringSet_holder(&x_set);
@@ -394,66 +390,62 @@ SEXP distMatrix(SEXP x, SEXP t, SEXP terminalGaps, SEXP penalizeGapLetters, SEXP
 		
 		tGaps = asLogical(terminalGaps);
 		pGapLetters = asLogical(penalizeGapLetters);
-		for (i = 0; i < last; i++) {
-			// extract each ith DNAString from the DNAStringSet
-			x_i = get_elt_from_XStringSet_holder(&x_set, i);
-			seqLength_i = x_i.length;
-			
-			#ifdef _OPENMP
-			#pragma omp parallel for private(j,x_j,seqLength_j,start,end,index,width) schedule(guided) num_threads(nthreads)
-			#endif
-			for (j = (i+1); j < x_length; j++) {
-				// extract each jth DNAString from the DNAStringSet
-				x_j = get_elt_from_XStringSet_holder(&x_set, j);
-				seqLength_j = x_j.length;
-				
-				if (o == 1) { // matrix
-					index = j + x_length*i;
-				} else { // dist
-					index = x_length*i - i*(i + 1)/2 + j - i - 1;
-				}
+		
+		// one parallel region avoids a fork and join per row
+		Progress prog;
+		initProgress(&prog, (double)last*(2*x_length - last - 1)/2, v, pBar);
+		#ifdef _OPENMP
+		#pragma omp parallel private(i,j,x_i,x_j,seqLength_i,seqLength_j,start,end,index,width) num_threads(nthreads)
+		#endif
+		{
+			for (i = 0; i < last; i++) {
+				// extract each ith DNAString from the DNAStringSet
+				x_i = get_elt_from_XStringSet_holder(&x_set, i);
+				seqLength_i = x_i.length;
+				double done = 0; // pairs completed by this thread
 				
-				// find the distance for each row of the matrix
-				if ((seqLength_i - gapLengths[1][i]) <= gapLengths[0][j] ||
-					gapLengths[0][i] >= (seqLength_j - gapLengths[1][j])) {
-					// no overlap between sequences
-					if (tGaps && // include terminal gaps
-						coverage == 0) { // do not require coverage
-						rans[index] = 1;
-					} else {
-						rans[index] = NA_REAL;
+				#ifdef _OPENMP
+				#pragma omp for schedule(guided) nowait
+				#endif
+				for (j = (i+1); j < x_length; j++) {
+					if (progressInterrupted(&prog))
+						continue;
+					done++;
+					
+					// extract each jth DNAString from the DNAStringSet
+					x_j = get_elt_from_XStringSet_holder(&x_set, j);
+					seqLength_j = x_j.length;
+					
+					if (o == 1) { // matrix
+						index = j + x_length*i;
+					} else { // dist
+						index = x_length*i - i*(i + 1)/2 + j - i - 1;
 					}
-				} else {
-					if (!tGaps) { // don't include terminal gaps
-						// find the intersection of both string's ranges
-						// to shorten the sequence comparison for speed
-						if (gapLengths[0][i] >= gapLengths[0][j]) {
-							start = gapLengths[0][i];
-						} else {
-							start = gapLengths[0][j];
-						}
-						if ((seqLength_i - gapLengths[1][i]) <= (seqLength_j - gapLengths[1][j])) {
-							end = gapLengths[1][i];
+					
+					// find the distance for each row of the matrix
+					if ((seqLength_i - gapLengths[1][i]) <= gapLengths[0][j] ||
+						gapLengths[0][i] >= (seqLength_j - gapLengths[1][j])) {
+						// no overlap between sequences
+						if (tGaps && // include terminal gaps
+							coverage == 0) { // do not require coverage
+							rans[index] = 1;
 						} else {
-							end = gapLengths[1][j];
+							rans[index] = NA_REAL;
 						}
-						if (seqLengths[i] <= seqLengths[j]) {
-							if (useMax == 0) {
-								width = seqLengths[i];
+					} else {
+						if (!tGaps) { // don't include terminal gaps
+							// find the intersection of both string's ranges
+							// to shorten the sequence comparison for speed
+							if (gapLengths[0][i] >= gapLengths[0][j]) {
+								start = gapLengths[0][i];
 							} else {
-								width = seqLengths[j];
+								start = gapLengths[0][j];
 							}
-						} else {
-							if (useMax == 0) {
-								width = seqLengths[j];
+							if ((seqLength_i - gapLengths[1][i]) <= (seqLength_j - gapLengths[1][j])) {
+								end = gapLengths[1][i];
 							} else {
-								width = seqLengths[i];
+								end = gapLengths[1][j];
 							}
-						}
-					} else { // use whole sequence including terminal gaps
-						if (mode == 1) { // overlap
-							start = 0;
-							end = 0;
 							if (seqLengths[i] <= seqLengths[j]) {
 								if (useMax == 0) {
 									width = seqLengths[i];
@@ -467,91 +459,104 @@ SEXP distMatrix(SEXP x, SEXP t, SEXP terminalGaps, SEXP penalizeGapLetters, SEXP
 									width = seqLengths[i];
 								}
 							}
-						} else if (mode == 2) { // shortest
-							if (seqLengths[i] <= seqLengths[j]) {
-								if (useMax == 0) {
-									width = seqLengths[i];
-								} else {
-									width = seqLengths[j];
-								}
-								start = gapLengths[0][i];
-								end = gapLengths[1][i];
-							} else {
-								if (useMax == 0) {
-									width = seqLengths[j];
+						} else { // use whole sequence including terminal gaps
+							if (mode == 1) { // overlap
+								start = 0;
+								end = 0;
+								if (seqLengths[i] <= seqLengths[j]) {
+									if (useMax == 0) {
+										width = seqLengths[i];
+									} else {
+										width = seqLengths[j];
+									}
 								} else {
-									width = seqLengths[i];
+									if (useMax == 0) {
+										width = seqLengths[j];
+									} else {
+										width = seqLengths[i];
+									}
 								}
-								start = gapLengths[0][j];
-								end = gapLengths[1][j];
-							}
-						} else { // longest
-							if (seqLengths[i] >= seqLengths[j]) {
-								if (useMax == 0) {
-									width = seqLengths[j];
+							} else if (mode == 2) { // shortest
+								if (seqLengths[i] <= seqLengths[j]) {
+									if (useMax == 0) {
+										width = seqLengths[i];
+									} else {
+										width = seqLengths[j];
+									}
+									start = gapLengths[0][i];
+									end = gapLengths[1][i];
 								} else {
-									width = seqLengths[i];
+									if (useMax == 0) {
+										width = seqLengths[j];
+									} else {
+										width = seqLengths[i];
+									}
+									start = gapLengths[0][j];
+									end = gapLengths[1][j];
 								}
-								start = gapLengths[0][i];
-								end = gapLengths[1][i];
-							} else {
-								if (useMax == 0) {
-									width = seqLengths[i];
+							} else { // longest
+								if (seqLengths[i] >= seqLengths[j]) {
+									if (useMax == 0) {
+										width = seqLengths[j];
+									} else {
+										width = seqLengths[i];
+									}
+									start = gapLengths[0][i];
+									end = gapLengths[1][i];
 								} else {
-									width = seqLengths[j];
+									if (useMax == 0) {
+										width = seqLengths[i];
+									} else {
+										width = seqLengths[j];
+									}
+									start = gapLengths[0][j];
+									end = gapLengths[1][j];
 								}
-								start = gapLengths[0][j];
-								end = gapLengths[1][j];
 							}
 						}
-					}
-					if (asInteger(t) == 3) { // AAStringSet
-						rans[index] = distanceAA(&x_i, &x_j, start, end, pGapLetters, width, coverage);
-					} else {
-						rans[index] = distance(&x_i, &x_j, start, end, pGapLetters, width, coverage);
-					}
-					if (E > 0) {
-						if (rans[index] >= E) {
-							rans[index] = R_PosInf;
+						if (asInteger(t) == 3) { // AAStringSet
+							rans[index] = distanceAA(&x_i, &x_j, start, end, pGapLetters, width, coverage);
 						} else {
-							rans[index] = 1 - rans[index]/E;
-							rans[index] = -E*log(rans[index]);
+							rans[index] = distance(&x_i, &x_j, start, end, pGapLetters, width, coverage);
+						}
+						if (E > 0) {
+							if (rans[index] >= E) {
+								rans[index] = R_PosInf;
+							} else {
+								rans[index] = 1 - rans[index]/E;
+								rans[index] = -E*log(rans[index]);
+							}
 						}
 					}
 				}
+				addProgress(&prog, done);
+				pollProgress(&prog); // master thread calls back to R
 			}
+		}
+		
+		free(gapLengths[0]);
+		free(gapLengths[1]);
+		free(seqLengths);
+		
+		if (finishProgress(&prog))
+			error("Received user interrupt.");
+		
+		for (i = 0; i < last; i++) {
 			if (fM && o == 1) // make the matrix symetrical
 				for (j = (i+1); j < x_length; j++)
 					rans[i + x_length*j] = rans[j + x_length*i];
 			
 			if (o == 1) // set the matrix diagonal to zero distance
 				rans[i*x_length + i] = 0;
-			
-			if (v) { // print the percent completed so far
-				soFar = (2*last - i)*(i + 1);
-				*rPercentComplete = floor(100*soFar/(last*(last + 1)));
-				if (*rPercentComplete > before) { // when the percent has changed
-					// tell the progress bar to update in the R console
-					eval(lang4(install("setTxtProgressBar"), pBar, percentComplete, R_NilValue), utilsPackage);
-					before = *rPercentComplete;
-				}
-			} else {
-				R_CheckUserInterrupt();
-			}
 		}
 		if (fM && o == 1) // set the last element of the diagonal to zero
 			rans[(x_length - 1)*x_length + (x_length - 1)] = 0;
-		
-		free(gapLengths[0]);
-		free(gapLengths[1]);
-		free(seqLengths);
 	}
 	
-	if (v) {
-		UNPROTECT(3);
-	} else {
-		UNPROTECT(1);
-	}
+	UNPROTECT(1);
+	
+	COUNT(COUNT_DISTANCES, (double)x_length*(x_length - 1)/2);
+	stopStage(STAGE_DIST_MATRIX, timer);
 	
 	return ans;	
 }
@@ -1489,40 +1494,211 @@ SEXP overlap(SEXP res, SEXP widths1, SEXP widths2)
 }
 
 // in-place addition of cophenetic distances
-SEXP cophenetic(SEXP Index1, SEXP N, SEXP D, SEXP H)
+static int isLeafNode(SEXP x)
+{
+	SEXP leaf = getAttrib(x, install("leaf"));
+	return TYPEOF(leaf) == LGLSXP && length(leaf) > 0 && LOGICAL(leaf)[0] == 1;
+}
+
+static double nodeHeight(SEXP x)
 {
-	int i, j, val;
-	int *I = INTEGER(Index1);
-	int l1 = length(Index1);
-	int n = asInteger(N);
-	double *d = REAL(D);
-	double h = asReal(H);
-	
-	char *t = Calloc(n, char);
-	for (i = 0; i < l1; i++)
-		t[I[i] - 1] = 1;
-	int l2 = n;
+	SEXP height = getAttrib(x, install("height"));
+	if (height == R_NilValue)
+		return 0;
+	return asReal(height);
+}
+
+static const int *leafValues;
+
+static int compareLeaves(const void *a, const void *b)
+{
+	int x = leafValues[*(const int *)a];
+	int y = leafValues[*(const int *)b];
+	if (x != y)
+		return (x > y) - (x < y);
+	return (*(const int *)a > *(const int *)b) - (*(const int *)a < *(const int *)b);
+}
+
+// cophenetic distances (or their correlation with y) from a dendrogram
+SEXP cophenetic(SEXP x, SEXP y, SEXP nThreads)
+{
+	int i, j, k;
+	int nthreads = asInteger(nThreads);
+	SEXP label = install("label");
+	
+	// walk the tree in order without recursion, recording each leaf
+	// and the node joining it to the previous leaf
+	int n = 0, size = 1000;
+	int *val = Calloc(size, int); // value of each leaf
+	double *h = Calloc(size, double); // height of each leaf
+	double *m = Calloc(size, double); // height of common ancestor with next leaf
+	int *level = Calloc(size, int); // depth of common ancestor with next leaf
+	SEXP *leaves = Calloc(size, SEXP);
+	int depth = 0, stackSize = 100, curLevel = INT_MAX;
+	double curHeight = 0;
+	SEXP *nodes = Calloc(stackSize, SEXP);
+	int *index = Calloc(stackSize, int);
+	nodes[0] = x;
+	index[0] = 0;
+	while (depth >= 0) {
+		SEXP node = nodes[depth];
+		if (index[depth] < length(node)) {
+			if (index[depth] > 0 && depth < curLevel) {
+				// shallowest node passed since the last leaf
+				curLevel = depth;
+				curHeight = nodeHeight(node);
+			}
+			SEXP child = VECTOR_ELT(node, index[depth]);
+			index[depth]++;
+			if (isLeafNode(child)) {
+				if (n == size) {
+					size *= 2;
+					val = Realloc(val, size, int);
+					h = Realloc(h, size, double);
+					m = Realloc(m, size, double);
+					level = Realloc(level, size, int);
+					leaves = Realloc(leaves, size, SEXP);
+				}
+				if (n > 0) {
+					m[n - 1] = curHeight;
+					level[n - 1] = curLevel;
+				}
+				val[n] = asInteger(child);
+				h[n] = nodeHeight(child);
+				leaves[n] = child;
+				n++;
+				curLevel = INT_MAX;
+			} else {
+				depth++;
+				if (depth == stackSize) {
+					stackSize *= 2;
+					nodes = Realloc(nodes, stackSize, SEXP);
+					index = Realloc(index, stackSize, int);
+				}
+				nodes[depth] = child;
+				index[depth] = 0;
+			}
+		} else {
+			depth--;
+		}
+	}
+	Free(nodes);
+	Free(index);
+	
+	// rank the leaves by their values
+	int *o = Calloc(n, int);
+	int *rank = Calloc(n, int);
 	for (i = 0; i < n; i++)
-		if (t[i])
-			l2--;
-	int *J = Calloc(l2, int);
-	j = 0;
+		o[i] = i;
+	leafValues = val;
+	qsort(o, n, sizeof(int), compareLeaves);
 	for (i = 0; i < n; i++)
-		if (!t[i])
-			J[j++] = i + 1;
-	Free(t);
-	
-	for (i = 0; i < l1; i++) {
-		for (j = 0; j < l2; j++) {
-			if (I[i] < J[j]) {
-				val = n*(I[i] - 1) - I[i]*(I[i] - 1)/2 + J[j] - I[i] - 1;
-			} else {
-				val = n*(J[j] - 1) - J[j]*(J[j] - 1)/2 + I[i] - J[j] - 1;
+		rank[o[i]] = i;
+	
+	SEXP labels;
+	PROTECT(labels = allocVector(STRSXP, n));
+	for (i = 0; i < n; i++) {
+		SEXP lab = getAttrib(leaves[o[i]], label);
+		if (lab == R_NilValue) {
+			SET_STRING_ELT(labels, i, NA_STRING);
+		} else {
+			SET_STRING_ELT(labels, i, asChar(lab));
+		}
+	}
+	
+	SEXP ans;
+	if (y == R_NilValue) {
+		PROTECT(ans = allocVector(REALSXP, (R_xlen_t)n*(n - 1)/2));
+		double *d = REAL(ans);
+		
+		#ifdef _OPENMP
+		#pragma omp parallel for private(i,j,k) schedule(dynamic) num_threads(nthreads)
+		#endif
+		for (i = 0; i < n - 1; i++) {
+			int minLevel = level[i];
+			double lca = m[i];
+			for (j = i + 1; j < n; j++) {
+				if (level[j - 1] < minLevel) {
+					minLevel = level[j - 1];
+					lca = m[j - 1];
+				}
+				R_xlen_t a = rank[i], b = rank[j];
+				if (a > b) {
+					k = a;
+					a = b;
+					b = k;
+				}
+				d[(R_xlen_t)n*a - a*(a + 1)/2 + b - a - 1] = 2*lca - h[i] - h[j];
+			}
+		}
+	} else {
+		// stream the pairs into the sums for Pearson's correlation in two
+		// passes, first for the means and then for the centered products
+		double *d = REAL(y);
+		double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0, count = 0;
+		double mx = 0, my = 0; // means
+		int pass;
+		
+		for (pass = 0; pass < 2; pass++) {
+			#ifdef _OPENMP
+			#pragma omp parallel for private(i,j,k) schedule(dynamic) reduction(+:sx,sy,sxx,syy,sxy,count) num_threads(nthreads)
+			#endif
+			for (i = 0; i < n - 1; i++) {
+				int minLevel = level[i];
+				double lca = m[i];
+				for (j = i + 1; j < n; j++) {
+					if (level[j - 1] < minLevel) {
+						minLevel = level[j - 1];
+						lca = m[j - 1];
+					}
+					R_xlen_t a = rank[i], b = rank[j];
+					if (a > b) {
+						k = a;
+						a = b;
+						b = k;
+					}
+					double v = d[(R_xlen_t)n*a - a*(a + 1)/2 + b - a - 1];
+					if (ISNAN(v))
+						continue;
+					double c = 2*lca - h[i] - h[j];
+					if (pass == 0) {
+						sx += c;
+						sy += v;
+						count++;
+					} else {
+						c -= mx;
+						v -= my;
+						sxx += c*c;
+						syy += v*v;
+						sxy += c*v;
+					}
+				}
+			}
+			
+			if (pass == 0) {
+				mx = sx/count;
+				my = sy/count;
 			}
-			d[val] += h;
 		}
+		
+		PROTECT(ans = allocVector(REALSXP, 1));
+		REAL(ans)[0] = sxy/sqrt(sxx*syy);
 	}
-	Free(J);
 	
-	return D;
+	Free(val);
+	Free(h);
+	Free(m);
+	Free(level);
+	Free(leaves);
+	Free(o);
+	Free(rank);
+	
+	SEXP ret_list;
+	PROTECT(ret_list = allocVector(VECSXP, 2));
+	SET_VECTOR_ELT(ret_list, 0, ans);
+	SET_VECTOR_ELT(ret_list, 1, labels);
+	
+	UNPROTECT(3);
+	
+	return ret_list;
 }
@@ -41,6 +41,8 @@
 // DECIPHER header file
 #include "DECIPHER.h"
 
+#define SUM_CHUNK 65536 // positions per part of the cumulative sum
+
 int getBase(const char p)
 {
 	switch (p) {
@@ -3082,44 +3084,46 @@ SEXP addIfElse(SEXP vec, SEXP index, SEXP scores)
 	return vec;
 }
 
-SEXP kmerScores(SEXP oligos, SEXP ints, SEXP windowSize, SEXP kSize)
+// background term shared by all k-mer models with the same windowSize
+SEXP kmerBackground(SEXP ints, SEXP windowSize)
 {
 	int i = 0, j = 0, k = 0, count = 0;
-	double *o = REAL(oligos);
 	int *mer = INTEGER(ints);
 	int wS = asInteger(windowSize);
-	double kS = asReal(kSize); // coerce to double
 	
 	int hS = wS/2; // half the windowSize
 	int l = length(ints);
-	int *bg = Calloc(length(oligos), int); // rolling distribution of k-mers
+	int n = 0; // number of possible k-mers
+	for (i = 0; i < l; i++)
+		if (mer[i] != NA_INTEGER && mer[i] > n)
+			n = mer[i];
+	int *bg = Calloc(n, int); // rolling distribution of k-mers
+	
+	// log of every possible count (zero for the pseudocount)
+	double *lc = Calloc(wS + 1, double);
+	for (i = 1; i <= wS; i++)
+		lc[i] = log((double)i);
 	
 	SEXP ans;
-	PROTECT(ans = allocVector(REALSXP, l + 1));
+	PROTECT(ans = allocVector(REALSXP, l));
 	double *rans = REAL(ans);
-	rans[0] = 0;
 	
-	// calculate:
-	// log(fg/sum(fg)/(1/n)) - log(bg/sum(bg)/(1/n))/kS
-	// log(oligos*n) - log(bg*n/count)/kS
-	// log(oligos*count/bg)/kS
+	// calculate the background term:
+	// log(count/bg)
 	
+	i = 0;
 	while (count < wS && i < l) {
 		if (mer[i] != NA_INTEGER) {
 			count++;
 			bg[mer[i] - 1]++;
 			
 			while (count >= wS) {
-				// record score at midpoint
+				// record background at midpoint
 				while (k <= i - hS) {
 					if (mer[k] != NA_INTEGER) {
-						if (bg[mer[k] - 1] > 0) {
-							rans[k + 1] = log(o[mer[k] - 1]*(double)count/(double)bg[mer[k] - 1])/kS;
-						} else { // use pseudocount
-							rans[k + 1] = log(o[mer[k] - 1]*(double)count)/kS;
-						}
+						rans[k] = lc[count] - lc[bg[mer[k] - 1]];
 					} else {
-						rans[k + 1] = 0;
+						rans[k] = 0;
 					}
 					k++;
 				}
@@ -3136,22 +3140,85 @@ SEXP kmerScores(SEXP oligos, SEXP ints, SEXP windowSize, SEXP kSize)
 	}
 	while (k < l) {
 		if (mer[k] != NA_INTEGER) {
-			if (bg[mer[k] - 1] > 0) {
-				rans[k + 1] = log(o[mer[k] - 1]*(double)count/(double)bg[mer[k] - 1])/kS;
-			} else { // use pseudocount
-				rans[k + 1] = log(o[mer[k] - 1]*(double)count)/kS;
-			}
+			rans[k] = lc[count] - lc[bg[mer[k] - 1]];
 		} else {
-			rans[k + 1] = 0;
+			rans[k] = 0;
 		}
 		k++;
 	}
 	
-	// perform cumulative sum
-	for (k = 2; k <= l; k++)
-		rans[k] += rans[k - 1];
-	
 	Free(bg);
+	Free(lc);
+	UNPROTECT(1);
+	
+	return ans;
+}
+
+SEXP kmerScores(SEXP oligos, SEXP ints, SEXP background, SEXP kSize, SEXP nThreads)
+{
+	int i, t;
+	int n = length(oligos);
+	double *o = REAL(oligos);
+	int *mer = INTEGER(ints);
+	double *b = REAL(background);
+	double kS = asReal(kSize); // coerce to double
+	int nthreads = asInteger(nThreads);
+	int l = length(ints);
+	
+	// calculate:
+	// log(fg/sum(fg)/(1/n)) - log(bg/sum(bg)/(1/n))/kS
+	// log(oligos*n) - log(bg*n/count)/kS
+	// log(oligos*count/bg)/kS
+	// (log(oligos) + log(count/bg))/kS
+	
+	double *lo = Calloc(n, double);
+	for (i = 0; i < n; i++)
+		lo[i] = log(o[i])/kS;
+	
+	SEXP ans;
+	PROTECT(ans = allocVector(REALSXP, l + 1));
+	double *rans = REAL(ans);
+	rans[0] = 0;
+	
+	// perform cumulative sum within contiguous parts of fixed
+	// size so that rounding does not depend on the number of threads
+	int size = SUM_CHUNK;
+	int parts = (l + size - 1)/size;
+	if (parts < 1)
+		parts = 1;
+	double *sums = Calloc(parts, double);
+	#ifdef _OPENMP
+	#pragma omp parallel for private(i,t) schedule(static) num_threads(nthreads)
+	#endif
+	for (t = 0; t < parts; t++) {
+		int end = (t + 1)*size;
+		if (end > l)
+			end = l;
+		double sum = 0;
+		for (i = t*size; i < end; i++) {
+			if (mer[i] != NA_INTEGER)
+				sum += lo[mer[i] - 1] + b[i]/kS;
+			rans[i + 1] = sum;
+		}
+		sums[t] = sum;
+	}
+	
+	// offset each part by the sum of preceding parts
+	for (t = 1; t < parts; t++)
+		sums[t] += sums[t - 1];
+	#ifdef _OPENMP
+	#pragma omp parallel for private(i,t) schedule(static) num_threads(nthreads)
+	#endif
+	for (t = 1; t < parts; t++) {
+		int end = (t + 1)*size;
+		if (end > l)
+			end = l;
+		for (i = t*size; i < end; i++)
+			rans[i + 1] += sums[t - 1];
+	}
+	
+	Free(lo);
+	Free(sums);
 	UNPROTECT(1);
 	
 	return ans;
@@ -3249,77 +3316,159 @@ SEXP maxPerORF(SEXP orftable, SEXP scores)
 	return ans;
 }
 
-SEXP scorePWM(SEXP pwm, SEXP x, SEXP minScore, SEXP nThreads)
+// score many PWMs in a single pass through the sequence
+SEXP scorePWMs(SEXP pwms, SEXP x, SEXP minScores, SEXP nThreads)
 {
-	int i, j, k, c, lkup;
-	int count = 0;
-	
-	double *p = REAL(pwm);
-	int l = length(pwm)/4; // length of pwm
-	double mS = asReal(minScore);
+	int i, j, k, t;
+	int n = length(pwms);
+	double *mS = REAL(minScores);
 	int nthreads = asInteger(nThreads);
+	int chunk = 4096; // positions scored per PWM at a time
 	
-	int *lookup = calloc(256, sizeof(int));
-	for (i = 0; i < 256; i++) {
-		if (i == 1) {
-			lookup[i] = 0;
-		} else if (i == 2) {
-			lookup[i] = 1;
-		} else if (i == 4) {
-			lookup[i] = 2;
-		} else if (i == 8) {
-			lookup[i] = 3;
-		} else {
-			lookup[i] = -1;
+	Chars_holder x_holder;
+	x_holder = hold_XRaw(x);
+	int L = x_holder.length;
+	
+	// encode the sequence once (4 denotes a non-base)
+	unsigned char *enc = Calloc(L, unsigned char);
+	for (i = 0; i < L; i++) {
+		switch (x_holder.ptr[i]) {
+			case 1:
+				enc[i] = 0;
+				break;
+			case 2:
+				enc[i] = 1;
+				break;
+			case 4:
+				enc[i] = 2;
+				break;
+			case 8:
+				enc[i] = 3;
+				break;
+			default:
+				enc[i] = 4;
+				break;
 		}
 	}
 	
-	Chars_holder x_holder;
-	x_holder = hold_XRaw(x);
+	// expand each PWM with a zero row for non-bases
+	double **p = Calloc(n, double *);
+	int *len = Calloc(n, int);
+	for (k = 0; k < n; k++) {
+		double *pwm = REAL(VECTOR_ELT(pwms, k));
+		len[k] = length(VECTOR_ELT(pwms, k))/4;
+		p[k] = Calloc(len[k]*5, double);
+		for (j = 0; j < len[k]; j++)
+			for (i = 0; i < 4; i++)
+				p[k][j*5 + i] = pwm[j*4 + i];
+	}
+	
+	// each thread scans a contiguous part of the sequence
+	int parts = nthreads;
+	if (parts < 1)
+		parts = 1;
+	int size = (L + parts - 1)/parts;
+	int **hitPos = Calloc(parts*n, int *);
+	double **hitSco = Calloc(parts*n, double *);
+	int *hitCount = Calloc(parts*n, int);
+	int *hitSize = Calloc(parts*n, int);
 	
-	double *scores = calloc(x_holder.length, sizeof(double));
 	#ifdef _OPENMP
-	#pragma omp parallel for private(i,j,k,lkup) num_threads(nthreads)
+	#pragma omp parallel for private(i,j,k,t) schedule(static, 1) num_threads(nthreads)
 	#endif
-	for (i = 0; i < x_holder.length - l + 1; i++) {
-		for (j = i, k = 0; j < i + l; j++, k += 4) {
-			lkup = lookup[(int)x_holder.ptr[j]];
-			if (lkup >= 0)
-				scores[i] += p[k + lkup];
+	for (t = 0; t < parts; t++) {
+		int begin = t*size;
+		int end = begin + size;
+		if (end > L)
+			end = L;
+		double *scores = (double *) calloc(chunk, sizeof(double)); // thread-safe on Windows
+		
+		for (int c = begin; c < end; c += chunk) {
+			int stop = c + chunk;
+			if (stop > end)
+				stop = end;
+			for (k = 0; k < n; k++) {
+				int last = L - len[k] + 1; // positions beyond are incomplete
+				int s = (stop < last) ? stop : last;
+				if (c >= s)
+					continue;
+				
+				double *q = p[k];
+				for (i = c; i < s; i++) {
+					double score = 0;
+					for (j = 0; j < len[k]; j++)
+						score += q[j*5 + enc[i + j]];
+					scores[i - c] = score;
+				}
+				
+				int h = t*n + k;
+				for (i = c; i < s; i++) {
+					if (scores[i - c] >= mS[k]) {
+						if (hitCount[h] == hitSize[h]) {
+							hitSize[h] = hitSize[h] ? 2*hitSize[h] : 64;
+							hitPos[h] = (int *) realloc(hitPos[h], hitSize[h]*sizeof(int));
+							hitSco[h] = (double *) realloc(hitSco[h], hitSize[h]*sizeof(double));
+						}
+						hitPos[h][hitCount[h]] = i + 1;
+						hitSco[h][hitCount[h]] = scores[i - c];
+						hitCount[h]++;
+					}
+				}
+			}
 		}
+		
+		free(scores);
 	}
-	free(lookup);
-	for (i = 0; i < x_holder.length - l + 1; i++)
-		if (scores[i] >= mS)
-			count++;
 	
-	SEXP position, score;
-	PROTECT(position = allocVector(INTSXP, count));
-	int *pos = INTEGER(position);
-	PROTECT(score = allocVector(REALSXP, count));
-	double *sco = REAL(score);
+	Free(enc);
+	for (k = 0; k < n; k++)
+		Free(p[k]);
+	Free(p);
+	Free(len);
 	
-	c = 0;
-	i = 0;
-	while (c < count) {
-		if (scores[i] >= mS) {
-			pos[c] = i + 1;
-			sco[c] = scores[i];
-			c++;
+	// concatenate the parts in order of position
+	SEXP ans;
+	PROTECT(ans = allocVector(VECSXP, n));
+	for (k = 0; k < n; k++) {
+		int count = 0;
+		for (t = 0; t < parts; t++)
+			count += hitCount[t*n + k];
+		
+		SEXP position, score, ret_list;
+		PROTECT(position = allocVector(INTSXP, count));
+		int *pos = INTEGER(position);
+		PROTECT(score = allocVector(REALSXP, count));
+		double *sco = REAL(score);
+		
+		count = 0;
+		for (t = 0; t < parts; t++) {
+			int h = t*n + k;
+			for (i = 0; i < hitCount[h]; i++) {
+				pos[count] = hitPos[h][i];
+				sco[count] = hitSco[h][i];
+				count++;
+			}
+			if (hitPos[h] != NULL) {
+				free(hitPos[h]);
+				free(hitSco[h]);
+			}
 		}
-		i++;
+		
+		PROTECT(ret_list = allocVector(VECSXP, 2));
+		SET_VECTOR_ELT(ret_list, 0, position);
+		SET_VECTOR_ELT(ret_list, 1, score);
+		SET_VECTOR_ELT(ans, k, ret_list);
+		UNPROTECT(3);
 	}
 	
-	free(scores);
-	
-	SEXP ret_list;
-	PROTECT(ret_list = allocVector(VECSXP, 2));
-	SET_VECTOR_ELT(ret_list, 0, position);
-	SET_VECTOR_ELT(ret_list, 1, score);
+	Free(hitPos);
+	Free(hitSco);
+	Free(hitCount);
+	Free(hitSize);
 	
-	UNPROTECT(3);
+	UNPROTECT(1);
 	
-	return ret_list;
+	return ans;
 }
 
 // return the top scoring pwm hit starting at each begin + positions + 1
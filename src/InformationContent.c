@@ -16,6 +16,9 @@
  */
 #include <R_ext/Rdynload.h>
 
+/* for Calloc/Free */
+#include <R_ext/RS.h>
+
 // for math functions
 #include <math.h>
 
@@ -201,3 +204,88 @@ SEXP informationContentAA(SEXP p, SEXP nS, SEXP correction, SEXP randomBackgroun
 	UNPROTECT(1);
 	return(ans);
 }
+
+// mask columns with many gaps or low windowed information content
+SEXP maskColumns(SEXP ic, SEXP gapFrac, SEXP maxGaps, SEXP windowSize, SEXP threshold, SEXP extend)
+{
+	int i, j;
+	double *a = REAL(ic);
+	double *g = REAL(gapFrac);
+	double mG = asReal(maxGaps);
+	int size = asInteger(windowSize);
+	double t = asReal(threshold);
+	int e = asLogical(extend);
+	int n = length(ic);
+	
+	SEXP mask, avgs;
+	PROTECT(mask = allocVector(LGLSXP, n));
+	int *m = LOGICAL(mask);
+	
+	// keep columns with few enough gaps
+	int l = 0;
+	int *keep = Calloc(n, int);
+	for (i = 0; i < n; i++) {
+		if (g[i] > mG) {
+			m[i] = 1;
+		} else {
+			m[i] = 0;
+			keep[l++] = i;
+		}
+	}
+	
+	if (size*2 + 1 > l) {
+		PROTECT(avgs = allocVector(REALSXP, 0));
+	} else {
+		PROTECT(avgs = allocVector(REALSXP, l));
+		double *c = REAL(avgs);
+		
+		// center-point moving average of a constant window size
+		double *cum = Calloc(l + 1, double); // prefix sums
+		for (i = 0; i < l; i++)
+			cum[i + 1] = cum[i] + a[keep[i]];
+		for (i = 0; i < l; i++) {
+			int left = i - size;
+			int right = i + size;
+			if (left < 0) {
+				left = 0;
+				right = 2*size;
+			} else if (right >= l) {
+				right = l - 1;
+				left = l - 1 - 2*size;
+			}
+			c[i] = (cum[right + 1] - cum[left])/(2*size + 1);
+		}
+		Free(cum);
+		
+		// extend each masked region to the nearest
+		// stretches of columns below the threshold
+		int *below = Calloc(l, int);
+		for (i = 0; i < l; i++)
+			below[i] = a[keep[i]] < t;
+		for (i = 0; i < l; i++) {
+			if (c[i] >= t)
+				continue;
+			m[keep[i]] = 1;
+			if (!e || (i > 0 && c[i - 1] < t))
+				continue; // not the start of a region
+			
+			for (j = i; j < l && !below[j]; j++);
+			for (; j < l && below[j]; j++)
+				m[keep[j]] = 1;
+			for (j = i; j >= 0 && !below[j]; j--);
+			for (; j >= 0 && below[j]; j--)
+				m[keep[j]] = 1;
+		}
+		Free(below);
+	}
+	Free(keep);
+	
+	SEXP ans;
+	PROTECT(ans = allocVector(VECSXP, 2));
+	SET_VECTOR_ELT(ans, 0, mask);
+	SET_VECTOR_ELT(ans, 1, avgs);
+	
+	UNPROTECT(3);
+	
+	return ans;
+}
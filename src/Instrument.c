@@ -0,0 +1,237 @@
+/****************************************************************************
+ *               Records Timers and Counters for Performance                *
+ *                           Author: Erik Wright                            *
+ ****************************************************************************/
+
+// for OpenMP parallel processing
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Rdefines.h is needed for the SEXP typedef, for the error(), INTEGER(),
+ * GET_DIM(), LOGICAL(), NEW_INTEGER(), PROTECT() and UNPROTECT() macros,
+ * and for the NA_INTEGER constant symbol.
+ */
+#include <Rdefines.h>
+
+/*
+ * R_ext/Rdynload.h is needed for the R_CallMethodDef typedef and the
+ * R_registerRoutines() prototype.
+ */
+#include <R_ext/Rdynload.h>
+
+// for calloc/free
+#include <stdlib.h>
+
+// for fopen/fprintf
+#include <stdio.h>
+
+// for clock and clock_gettime
+#include <time.h>
+
+// for gettimeofday
+#include <sys/time.h>
+
+// DECIPHER header file
+#include "DECIPHER.h"
+
+int instrumentOn = 0; // whether to record timers and counters
+
+static const char *stageNames[NUM_STAGES] = {"alignProfiles", "alignPairs", "searchIndex", "distMatrix", "cluster", "clusterML"};
+static const char *counterNames[NUM_COUNTERS] = {"dpCells", "kmerHits", "distances", "merges", "likelihoods", "bandExpansions"};
+
+static double wallTime[NUM_STAGES]; // seconds
+static double cpuTime[NUM_STAGES]; // seconds
+static double calls[NUM_STAGES];
+static double counts[NUM_COUNTERS];
+
+// sampled intervals for a trace file
+typedef struct {
+	int stage, thread;
+	double start, end; // seconds since enabled
+} TraceEvent;
+static TraceEvent *trace = NULL;
+static int traceSize = 0, traceLength = 0;
+static int sampleEvery = 1; // trace every nth call of a stage
+static double origin = 0; // wall time when enabled
+
+static double wallClock()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec/1e6;
+}
+
+// CPU time of the process, or of the calling thread when
+// other threads may be running other stages at the same time
+static double cpuClock(int threadCPU)
+{
+	#ifdef CLOCK_THREAD_CPUTIME_ID
+	if (threadCPU) {
+		struct timespec ts;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		return (double)ts.tv_sec + (double)ts.tv_nsec/1e9;
+	}
+	#endif
+	return (double)clock()/CLOCKS_PER_SEC;
+}
+
+// stages entered outside of a parallel region are charged the CPU time
+// of every thread they start, while stages entered from within one are
+// charged only the CPU time of the thread that runs them
+StageTimer startStage()
+{
+	StageTimer t = {0, 0, 0};
+	if (instrumentOn) {
+		#ifdef _OPENMP
+		t.threadCPU = omp_in_parallel();
+		#endif
+		t.wall = wallClock();
+		t.cpu = cpuClock(t.threadCPU);
+	}
+	return t;
+}
+
+void stopStage(int stage, StageTimer t)
+{
+	if (!instrumentOn || t.wall == 0)
+		return; // not enabled when the stage started
+	
+	double wall = wallClock();
+	double cpu = cpuClock(t.threadCPU);
+	#ifdef _OPENMP
+	int thread = omp_get_thread_num();
+	#else
+	int thread = 0;
+	#endif
+	
+	#ifdef _OPENMP
+	#pragma omp critical(instrument)
+	#endif
+	{
+		wallTime[stage] += wall - t.wall;
+		cpuTime[stage] += cpu - t.cpu;
+		if ((long long)calls[stage] % sampleEvery == 0) {
+			if (traceLength == traceSize) {
+				int size = (traceSize == 0) ? 1024 : 2*traceSize;
+				TraceEvent *temp = (TraceEvent *) realloc(trace, size*sizeof(TraceEvent)); // thread-safe on Windows
+				if (temp != NULL) {
+					trace = temp;
+					traceSize = size;
+				} // else stop tracing and keep the events so far
+			}
+			if (traceLength < traceSize) {
+				trace[traceLength].stage = stage;
+				trace[traceLength].thread = thread;
+				trace[traceLength].start = t.wall - origin;
+				trace[traceLength].end = wall - origin;
+				traceLength++;
+			}
+		}
+		calls[stage]++;
+	}
+}
+
+void addCount(int counter, double n)
+{
+	#ifdef _OPENMP
+	#pragma omp atomic
+	#endif
+	counts[counter] += n;
+}
+
+static void resetInstrument()
+{
+	int i;
+	
+	for (i = 0; i < NUM_STAGES; i++) {
+		wallTime[i] = 0;
+		cpuTime[i] = 0;
+		calls[i] = 0;
+	}
+	for (i = 0; i < NUM_COUNTERS; i++)
+		counts[i] = 0;
+	free(trace);
+	trace = NULL;
+	traceSize = 0;
+	traceLength = 0;
+	origin = wallClock();
+}
+
+// turn instrumentation on or off and return the prior state
+SEXP setInstrument(SEXP enable, SEXP sample, SEXP reset)
+{
+	int prior = instrumentOn;
+	
+	if (asLogical(reset))
+		resetInstrument();
+	sampleEvery = asInteger(sample);
+	if (sampleEvery < 1)
+		sampleEvery = 1;
+	if (origin == 0)
+		origin = wallClock();
+	instrumentOn = asLogical(enable);
+	
+	return ScalarLogical(prior);
+}
+
+// summarize the timers and counters, optionally writing a trace file
+SEXP getInstrument(SEXP file)
+{
+	int i;
+	
+	if (!isNull(file)) {
+		// Chrome trace event format readable by flame graph viewers
+		FILE *f = fopen(CHAR(STRING_ELT(file, 0)), "w");
+		if (f == NULL)
+			error("Unable to open trace file.");
+		fprintf(f, "{\"traceEvents\":[");
+		for (i = 0; i < traceLength; i++)
+			fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.0f,\"dur\":%.0f}",
+				(i == 0) ? "" : ",",
+				stageNames[trace[i].stage],
+				trace[i].thread,
+				trace[i].start*1e6,
+				(trace[i].end - trace[i].start)*1e6);
+		fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+		fclose(f);
+	}
+	
+	SEXP ans, stages, counters, names, vec;
+	PROTECT(ans = allocVector(VECSXP, 2));
+	
+	PROTECT(stages = allocVector(VECSXP, 4));
+	PROTECT(names = allocVector(STRSXP, NUM_STAGES));
+	for (i = 0; i < NUM_STAGES; i++)
+		SET_STRING_ELT(names, i, mkChar(stageNames[i]));
+	SET_VECTOR_ELT(stages, 0, names);
+	PROTECT(vec = allocVector(REALSXP, NUM_STAGES));
+	for (i = 0; i < NUM_STAGES; i++)
+		REAL(vec)[i] = calls[i];
+	SET_VECTOR_ELT(stages, 1, vec);
+	PROTECT(vec = allocVector(REALSXP, NUM_STAGES));
+	for (i = 0; i < NUM_STAGES; i++)
+		REAL(vec)[i] = wallTime[i];
+	SET_VECTOR_ELT(stages, 2, vec);
+	PROTECT(vec = allocVector(REALSXP, NUM_STAGES));
+	for (i = 0; i < NUM_STAGES; i++)
+		REAL(vec)[i] = cpuTime[i];
+	SET_VECTOR_ELT(stages, 3, vec);
+	SET_VECTOR_ELT(ans, 0, stages);
+	
+	PROTECT(counters = allocVector(VECSXP, 2));
+	PROTECT(names = allocVector(STRSXP, NUM_COUNTERS));
+	for (i = 0; i < NUM_COUNTERS; i++)
+		SET_STRING_ELT(names, i, mkChar(counterNames[i]));
+	SET_VECTOR_ELT(counters, 0, names);
+	PROTECT(vec = allocVector(REALSXP, NUM_COUNTERS));
+	for (i = 0; i < NUM_COUNTERS; i++)
+		REAL(vec)[i] = counts[i];
+	SET_VECTOR_ELT(counters, 1, vec);
+	SET_VECTOR_ELT(ans, 1, counters);
+	
+	UNPROTECT(9);
+	
+	return ans;
+}
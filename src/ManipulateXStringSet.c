@@ -30,6 +30,9 @@
 // strcpy
 #include <string.h>
 
+// for calloc/free
+#include <stdlib.h>
+
 /*
  * Biostrings_interface.h is needed for the DNAencode(), get_XString_asRoSeq(),
  * init_match_reporting(), report_match() and reported_matches_asSEXP()
@@ -257,306 +260,138 @@ SEXP consolidateGaps(SEXP x, SEXP type)
 }
 
 // quickly replace characters
-SEXP replaceChars(SEXP x, SEXP r, SEXP t)
+SEXP replaceChars(SEXP x, SEXP r, SEXP t, SEXP nThreads)
 {
-	int i, j, l, count;
+	int i;
+	size_t j, k, l;
 	int n = length(x);
-	int longest = 0;
-	const char *seq;
+	int type = asInteger(t);
+	int nthreads = asInteger(nThreads);
 	const char *repChar = CHAR(STRING_ELT(r, 0));
 	int fail = (STRING_ELT(r, 0) == NA_STRING);
 	
-	// find longest string
-	for (i = 0; i < n; i++)
-		if (length(STRING_ELT(x, i)) > longest)
-			longest = length(STRING_ELT(x, i));
+	// build the translation table once
+	// (zero denotes an incompatible character)
+	unsigned char map[256] = {0};
+	const char *valid;
+	if (type == 1) {
+		valid = "-ACGTNMRWSYKVHDBacgtnmrwsykvhdb+.";
+	} else if (type == 2) {
+		valid = "-ACGUNMRWSYKVHDBacgunmrwsykvhdb+.";
+	} else {
+		valid = "-ARNDCQEGHILKMFPSTWYVUOBJZX*+.";
+	}
+	for (j = 0; valid[j] != '\0'; j++)
+		map[(unsigned char)valid[j]] = valid[j];
+	if (type == 1) {
+		map['U'] = 'T';
+		map['u'] = 'T';
+	} else if (type == 2) {
+		map['T'] = 'U';
+		map['t'] = 'U';
+	} else {
+		for (j = 'a'; j <= 'z'; j++)
+			if (map[j - 'a' + 'A'])
+				map[j] = j - 'a' + 'A';
+	}
+	if (!fail) {
+		for (j = 1; j < 256; j++)
+			if (map[j] == 0)
+				map[j] = repChar[0]; // remains zero if dropped
+	}
 	
-	SEXP seqs;
-	PROTECT(seqs = allocVector(STRSXP, n));
-	char *s = Calloc(longest + 1, char); // each sequence
+	const char **strs = Calloc(n, const char *); // original strings
+	char **outs = Calloc(n, char *); // translated strings (or NULL if unchanged)
+	size_t *lens = Calloc(n, size_t); // length of translated strings
+	char *bad = Calloc(n, char); // first incompatible character
+	int oom = 0; // whether any allocation failed
 	
-	// write new character vector
-	if (asInteger(t) == 1) {
-		for (i = 0; i < n; i++) {
-			l = length(STRING_ELT(x, i));
-			seq = CHAR(STRING_ELT(x, i));
-			count = 0;
-			for (j = 0; j < l; j++) {
-				if (seq[j] != 'U' && seq[j] != 'u') {
-					switch (seq[j]) {
-						case '-':
-						case 'A':
-						case 'a':
-						case 'C':
-						case 'c':
-						case 'G':
-						case 'g':
-						case 'T':
-						case 't':
-						case 'N':
-						case 'n':
-						case 'M':
-						case 'm':
-						case 'R':
-						case 'r':
-						case 'W':
-						case 'w':
-						case 'S':
-						case 's':
-						case 'Y':
-						case 'y':
-						case 'K':
-						case 'k':
-						case 'V':
-						case 'v':
-						case 'H':
-						case 'h':
-						case 'D':
-						case 'd':
-						case 'B':
-						case 'b':
-						case '+':
-						case '.':
-							s[count] = seq[j];
-							count++;
-							break;
-						default:
-							if (fail) {
-								error("Incompatible character ('%c') found in DNAStringSet when replaceChar = NA.", seq[j]);
-							} else if (repChar[0] != '\0') {
-								s[count] = repChar[0];
-								count++;
-							}
-							break;
-					}
-				} else {
-					s[count] = 'T';
-					count++;
-				}
-			}
-			s[count] = '\0'; // null-terminate
-			SET_STRING_ELT(seqs, i, mkChar(s));
+	// build a vector of thread-safe pointers
+	for (i = 0; i < n; i++) {
+		strs[i] = CHAR(STRING_ELT(x, i));
+		lens[i] = (size_t)LENGTH(STRING_ELT(x, i));
+	}
+	
+	#ifdef _OPENMP
+	#pragma omp parallel for private(i,j,k,l) schedule(guided) num_threads(nthreads)
+	#endif
+	for (i = 0; i < n; i++) {
+		const char *seq = strs[i];
+		l = lens[i];
+		
+		// most sequences are already compatible
+		for (j = 0; j < l; j++)
+			if (map[(unsigned char)seq[j]] != (unsigned char)seq[j])
+				break;
+		if (j == l)
+			continue;
+		
+		char *s = (char *) malloc(l*sizeof(char)); // thread-safe on Windows
+		if (s == NULL) {
+			oom = 1;
+			continue;
 		}
-	} else if (asInteger(t) == 2) {
-		for (i = 0; i < n; i++) {
-			l = length(STRING_ELT(x, i));
-			seq = CHAR(STRING_ELT(x, i));
-			count = 0;
-			for (j = 0; j < l; j++) {
-				if (seq[j] != 'T' && seq[j] != 't') {
-					switch (seq[j]) {
-						case '-':
-						case 'A':
-						case 'a':
-						case 'C':
-						case 'c':
-						case 'G':
-						case 'g':
-						case 'U':
-						case 'u':
-						case 'N':
-						case 'n':
-						case 'M':
-						case 'm':
-						case 'R':
-						case 'r':
-						case 'W':
-						case 'w':
-						case 'S':
-						case 's':
-						case 'Y':
-						case 'y':
-						case 'K':
-						case 'k':
-						case 'V':
-						case 'v':
-						case 'H':
-						case 'h':
-						case 'D':
-						case 'd':
-						case 'B':
-						case 'b':
-						case '+':
-						case '.':
-							s[count] = seq[j];
-							count++;
-							break;
-						default:
-							if (fail) {
-								error("Incompatible character ('%c') in RNAStringSet found when replaceChar = NA.", seq[j]);
-							} else if (repChar[0] != '\0') {
-								s[count] = repChar[0];
-								count++;
-							}
-							break;
-					}
-				} else {
-					s[count] = 'U';
-					count++;
-				}
+		memcpy(s, seq, j);
+		k = j;
+		for (; j < l; j++) {
+			unsigned char c = map[(unsigned char)seq[j]];
+			if (c) {
+				s[k++] = c;
+			} else if (fail) {
+				bad[i] = seq[j];
+				break;
 			}
-			s[count] = '\0'; // null-terminate
-			SET_STRING_ELT(seqs, i, mkChar(s));
 		}
-	} else {
-		for (i = 0; i < n; i++) {
-			l = length(STRING_ELT(x, i));
-			seq = CHAR(STRING_ELT(x, i));
-			count = 0;
-			for (j = 0; j < l; j++) {
-				switch (seq[j]) {
-					case '-':
-					case 'A':
-					case 'R':
-					case 'N':
-					case 'D':
-					case 'C':
-					case 'Q':
-					case 'E':
-					case 'G':
-					case 'H':
-					case 'I':
-					case 'L':
-					case 'K':
-					case 'M':
-					case 'F':
-					case 'P':
-					case 'S':
-					case 'T':
-					case 'W':
-					case 'Y':
-					case 'V':
-					case 'U':
-					case 'O':
-					case 'B':
-					case 'Z':
-					case 'X':
-					case '*':
-					case '+':
-					case '.':
-						s[count] = seq[j];
-						count++;
-						break;
-					case 'a':
-						s[count] = 'A';
-						count++;
-						break;
-					case 'r':
-						s[count] = 'R';
-						count++;
-						break;
-					case 'n':
-						s[count] = 'N';
-						count++;
-						break;
-					case 'd':
-						s[count] = 'D';
-						count++;
-						break;
-					case 'c':
-						s[count] = 'C';
-						count++;
-						break;
-					case 'q':
-						s[count] = 'Q';
-						count++;
-						break;
-					case 'e':
-						s[count] = 'E';
-						count++;
-						break;
-					case 'g':
-						s[count] = 'G';
-						count++;
-						break;
-					case 'h':
-						s[count] = 'H';
-						count++;
-						break;
-					case 'i':
-						s[count] = 'I';
-						count++;
-						break;
-					case 'l':
-						s[count] = 'L';
-						count++;
-						break;
-					case 'k':
-						s[count] = 'K';
-						count++;
-						break;
-					case 'm':
-						s[count] = 'M';
-						count++;
-						break;
-					case 'f':
-						s[count] = 'F';
-						count++;
-						break;
-					case 'p':
-						s[count] = 'P';
-						count++;
-						break;
-					case 's':
-						s[count] = 'S';
-						count++;
-						break;
-					case 't':
-						s[count] = 'T';
-						count++;
-						break;
-					case 'w':
-						s[count] = 'W';
-						count++;
-						break;
-					case 'y':
-						s[count] = 'Y';
-						count++;
-						break;
-					case 'v':
-						s[count] = 'V';
-						count++;
-						break;
-					case 'u':
-						s[count] = 'U';
-						count++;
-						break;
-					case 'o':
-						s[count] = 'O';
-						count++;
-						break;
-					case 'b':
-						s[count] = 'B';
-						count++;
-						break;
-					case 'j':
-						s[count] = 'J';
-						count++;
-						break;
-					case 'z':
-						s[count] = 'Z';
-						count++;
-						break;
-					case 'x':
-						s[count] = 'X';
-						count++;
-						break;
-					default:
-						if (fail) {
-							error("Incompatible character ('%c') in AAStringSet found when replaceChar = NA.", seq[j]);
-						} else if (repChar[0] != '\0') {
-							s[count] = repChar[0];
-							count++;
-						}
-						break;
-				}
+		outs[i] = s;
+		lens[i] = k;
+	}
+	
+	if (oom) {
+		for (i = 0; i < n; i++)
+			free(outs[i]);
+		Free(strs);
+		Free(outs);
+		Free(lens);
+		Free(bad);
+		error("Out of memory");
+	}
+	
+	for (i = 0; i < n; i++) {
+		if (bad[i]) {
+			char c = bad[i];
+			for (j = 0; j < n; j++)
+				if (outs[j])
+					free(outs[j]);
+			Free(strs);
+			Free(outs);
+			Free(lens);
+			Free(bad);
+			if (type == 1) {
+				error("Incompatible character ('%c') found in DNAStringSet when replaceChar = NA.", c);
+			} else if (type == 2) {
+				error("Incompatible character ('%c') in RNAStringSet found when replaceChar = NA.", c);
+			} else {
+				error("Incompatible character ('%c') in AAStringSet found when replaceChar = NA.", c);
 			}
-			s[count] = '\0'; // null-terminate
-			SET_STRING_ELT(seqs, i, mkChar(s));
 		}
 	}
 	
-	Free(s);
+	// write new character vector
+	SEXP seqs;
+	PROTECT(seqs = allocVector(STRSXP, n));
+	for (i = 0; i < n; i++) {
+		if (outs[i]) {
+			SET_STRING_ELT(seqs, i, mkCharLen(outs[i], (int)lens[i]));
+			free(outs[i]);
+		} else { // reuse the unchanged string
+			SET_STRING_ELT(seqs, i, STRING_ELT(x, i));
+		}
+	}
+	
+	Free(strs);
+	Free(outs);
+	Free(lens);
+	Free(bad);
 	
 	UNPROTECT(1);
 	
@@ -586,8 +421,17 @@ SEXP replaceChar(SEXP x, SEXP c, SEXP r)
 	for (i = 0; i < n; i++) {
 		l = length(STRING_ELT(x, i));
 		seq = CHAR(STRING_ELT(x, i));
-		count = 0;
-		for (j = 0; j < l; j++) {
+		
+		// reuse strings lacking the character
+		const char *p = memchr(seq, charRep[0], l);
+		if (p == NULL) {
+			SET_STRING_ELT(seqs, i, STRING_ELT(x, i));
+			continue;
+		}
+		
+		count = p - seq;
+		memcpy(s, seq, count);
+		for (j = count; j < l; j++) {
 			if (seq[j] == charRep[0]) {
 				if (repChar[0] != '\0') {
 					s[count] = repChar[0];
@@ -598,8 +442,7 @@ SEXP replaceChar(SEXP x, SEXP c, SEXP r)
 				count++;
 			}
 		}
-		s[count] = '\0'; // null-terminate
-		SET_STRING_ELT(seqs, i, mkChar(s));
+		SET_STRING_ELT(seqs, i, mkCharLen(s, count));
 	}
 	
 	Free(s);
@@ -0,0 +1,313 @@
+/****************************************************************************
+ *             Approximately Matches Many Patterns to Many Subjects         *
+ *                           Author: Erik Wright                            *
+ ****************************************************************************/
+
+// for OpenMP parallel processing
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Rdefines.h is needed for the SEXP typedef, for the error(), INTEGER(),
+ * GET_DIM(), LOGICAL(), NEW_INTEGER(), PROTECT() and UNPROTECT() macros,
+ * and for the NA_INTEGER constant symbol.
+ */
+#include <Rdefines.h>
+
+/*
+ * R_ext/Rdynload.h is needed for the R_CallMethodDef typedef and the
+ * R_registerRoutines() prototype.
+ */
+#include <R_ext/Rdynload.h>
+
+/* for Calloc/Free */
+#include <R_ext/RS.h>
+
+// for calloc/free
+#include <stdlib.h>
+
+// for uint64_t
+#include <stdint.h>
+
+/*
+ * Biostrings_interface.h is needed for the DNAencode(), get_XString_asRoSeq(),
+ * init_match_reporting(), report_match() and reported_matches_asSEXP()
+ * protoypes, and for the COUNT_MRMODE and START_MRMODE constant symbols.
+ */
+#include "Biostrings_interface.h"
+
+// DECIPHER header file
+#include "DECIPHER.h"
+
+// subject letters are fixed and pattern letters may be ambiguous
+#define MATCHES(s, p) (((s) & ~(p)) == 0)
+
+// growable table of hits found by one thread
+typedef struct {
+	R_xlen_t n, size;
+	int *subject, *pattern, *start, *end, *dist;
+} Hits;
+
+static void addHit(Hits *h, int subject, int pattern, int start, int end, int dist)
+{
+	if (h->n == h->size) {
+		h->size = (h->size == 0) ? 1024 : 2*h->size;
+		h->subject = (int *) realloc(h->subject, h->size*sizeof(int)); // thread-safe on Windows
+		h->pattern = (int *) realloc(h->pattern, h->size*sizeof(int));
+		h->start = (int *) realloc(h->start, h->size*sizeof(int));
+		h->end = (int *) realloc(h->end, h->size*sizeof(int));
+		h->dist = (int *) realloc(h->dist, h->size*sizeof(int));
+	}
+	h->subject[h->n] = subject;
+	h->pattern[h->n] = pattern;
+	h->start[h->n] = start;
+	h->end[h->n] = end;
+	h->dist[h->n] = dist;
+	h->n++;
+}
+
+// length of the shortest suffix of s[0...e] within edit distance d of
+// the pattern (p is compared right-to-left from its last letter)
+static int matchStart(const unsigned char *p, int l, const unsigned char *s, int e, int d)
+{
+	int i, j, diag, temp, len = l;
+	
+	int n = e + 1;
+	if (n > l + d)
+		n = l + d;
+	
+	int *col = (int *) malloc((l + 1)*sizeof(int)); // thread-safe on Windows
+	for (i = 0; i <= l; i++)
+		col[i] = i;
+	if (col[l] > d) {
+		for (j = 0; j < n; j++) {
+			diag = col[0];
+			col[0] = j + 1;
+			for (i = 1; i <= l; i++) {
+				temp = col[i];
+				col[i] = diag + (MATCHES(s[e - j], p[l - i]) ? 0 : 1);
+				if (temp + 1 < col[i])
+					col[i] = temp + 1;
+				if (col[i - 1] + 1 < col[i])
+					col[i] = col[i - 1] + 1;
+				diag = temp;
+			}
+			if (col[l] <= d) {
+				len = j + 1;
+				break;
+			}
+		}
+	} else {
+		len = 0;
+	}
+	free(col);
+	
+	return e - len + 2; // one-based start
+}
+
+// report the best local match within each valley of edit distances
+static void reportValleys(Hits *h, int subject, int pattern, const unsigned char *p, int l, const unsigned char *s, int j, int score, int *prev, int *pending, int k)
+{
+	if (*pending >= 0 && score > *prev) {
+		addHit(h, subject, pattern, matchStart(p, l, s, *pending, *prev), *pending + 1, *prev);
+		*pending = -1;
+	}
+	if (score <= k && score < *prev) {
+		*pending = j;
+	} else if (score < *prev) {
+		*pending = -1;
+	}
+	*prev = score;
+}
+
+// semi-global edit distance search with Myers' bit-vector algorithm
+static void myersSearch(Hits *h, int subject, int pattern, const unsigned char *p, int l, const uint64_t *peq, const unsigned char *s, int n, int k)
+{
+	int j, score = l, prev = l, pending = -1;
+	uint64_t mask = (l == 64) ? ~((uint64_t)0) : (((uint64_t)1 << l) - 1);
+	uint64_t high = (uint64_t)1 << (l - 1);
+	uint64_t Pv = mask, Mv = 0, Eq, Xv, Xh, Ph, Mh;
+	
+	for (j = 0; j < n; j++) {
+		Eq = peq[s[j]];
+		Xv = Eq | Mv;
+		Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+		Ph = Mv | ~(Xh | Pv);
+		Mh = Pv & Xh;
+		if (Ph & high) {
+			score++;
+		} else if (Mh & high) {
+			score--;
+		}
+		Ph <<= 1; // the match may start anywhere
+		Mh <<= 1;
+		Pv = (Mh | ~(Xv | Ph)) & mask;
+		Mv = Ph & Xv & mask;
+		reportValleys(h, subject, pattern, p, l, s, j, score, &prev, &pending, k);
+	}
+	if (pending >= 0)
+		addHit(h, subject, pattern, matchStart(p, l, s, pending, prev), pending + 1, prev);
+}
+
+// same as myersSearch for patterns longer than a machine word
+static void dpSearch(Hits *h, int subject, int pattern, const unsigned char *p, int l, const unsigned char *s, int n, int k)
+{
+	int i, j, diag, temp, prev = l, pending = -1;
+	
+	int *col = (int *) malloc((l + 1)*sizeof(int)); // thread-safe on Windows
+	for (i = 0; i <= l; i++)
+		col[i] = i;
+	
+	for (j = 0; j < n; j++) {
+		diag = 0;
+		col[0] = 0;
+		for (i = 1; i <= l; i++) {
+			temp = col[i];
+			col[i] = diag + (MATCHES(s[j], p[i - 1]) ? 0 : 1);
+			if (temp + 1 < col[i])
+				col[i] = temp + 1;
+			if (col[i - 1] + 1 < col[i])
+				col[i] = col[i - 1] + 1;
+			diag = temp;
+		}
+		reportValleys(h, subject, pattern, p, l, s, j, col[l], &prev, &pending, k);
+	}
+	if (pending >= 0)
+		addHit(h, subject, pattern, matchStart(p, l, s, pending, prev), pending + 1, prev);
+	
+	free(col);
+}
+
+// every position where a pattern matches with at most k mismatches
+static void hammingSearch(Hits *h, int subject, int pattern, const unsigned char *p, int l, const unsigned char *s, int n, int k)
+{
+	int i, j, mm;
+	
+	for (j = 0; j <= n - l; j++) {
+		mm = 0;
+		for (i = 0; i < l; i++) {
+			if (!MATCHES(s[j + i], p[i])) {
+				if (++mm > k)
+					break;
+			}
+		}
+		if (mm <= k)
+			addHit(h, subject, pattern, j + 1, j + l, mm);
+	}
+}
+
+// find all patterns in all subjects at once
+SEXP matchPatterns(SEXP x, SEXP patterns, SEXP maxDist, SEXP withIndels, SEXP nThreads)
+{
+	int i, j, c, k, l;
+	
+	int *mD = INTEGER(maxDist);
+	int indels = asLogical(withIndels);
+	int nthreads = asInteger(nThreads);
+	
+	XStringSet_holder x_set, p_set;
+	x_set = hold_XStringSet(x);
+	int n = get_length_from_XStringSet_holder(&x_set);
+	p_set = hold_XStringSet(patterns);
+	int nP = get_length_from_XStringSet_holder(&p_set);
+	if (length(maxDist) != nP)
+		error("maxDist must have one element per pattern.");
+	
+	// encode each pattern and its bit masks of matching letters
+	const unsigned char **pats = Calloc(nP, const unsigned char *);
+	int *lens = Calloc(nP, int);
+	uint64_t **peqs = Calloc(nP, uint64_t *);
+	for (i = 0; i < nP; i++) {
+		Chars_holder p_i = get_elt_from_XStringSet_holder(&p_set, i);
+		pats[i] = (const unsigned char *)p_i.ptr;
+		lens[i] = p_i.length;
+		if (indels && lens[i] <= 64) {
+			peqs[i] = Calloc(256, uint64_t); // initialized to zero
+			for (c = 0; c < 256; c++)
+				for (j = 0; j < lens[i]; j++)
+					if (MATCHES(c, pats[i][j]))
+						peqs[i][c] |= (uint64_t)1 << j;
+		}
+	}
+	
+	Hits *hits = Calloc(nthreads, Hits); // initialized to zero
+	
+	// contiguous blocks of subject and pattern pairs keep the hits in order
+	R_xlen_t m = (R_xlen_t)n*nP, pair;
+	#ifdef _OPENMP
+	#pragma omp parallel for private(i,k,l) schedule(static) num_threads(nthreads)
+	#endif
+	for (pair = 0; pair < m; pair++) {
+		#ifdef _OPENMP
+		int t = omp_get_thread_num();
+		#else
+		int t = 0;
+		#endif
+		i = (int)(pair/nP);
+		k = (int)(pair%nP);
+		l = lens[k];
+		if (l == 0)
+			continue;
+		Chars_holder x_i = get_elt_from_XStringSet_holder(&x_set, i);
+		const unsigned char *s = (const unsigned char *)x_i.ptr;
+		
+		if (!indels) {
+			hammingSearch(hits + t, i + 1, k + 1, pats[k], l, s, x_i.length, mD[k]);
+		} else if (l <= 64) {
+			myersSearch(hits + t, i + 1, k + 1, pats[k], l, peqs[k], s, x_i.length, mD[k]);
+		} else {
+			dpSearch(hits + t, i + 1, k + 1, pats[k], l, s, x_i.length, mD[k]);
+		}
+	}
+	
+	for (i = 0; i < nP; i++)
+		if (peqs[i])
+			Free(peqs[i]);
+	Free(pats);
+	Free(lens);
+	Free(peqs);
+	
+	// concatenate the hits of all threads
+	R_xlen_t total = 0, h_i;
+	for (i = 0; i < nthreads; i++)
+		total += hits[i].n;
+	
+	SEXP ans, col;
+	PROTECT(ans = allocVector(VECSXP, 5));
+	for (j = 0; j < 5; j++) {
+		PROTECT(col = allocVector(INTSXP, total));
+		int *v = INTEGER(col);
+		for (i = 0; i < nthreads; i++) {
+			int *h;
+			if (j == 0) {
+				h = hits[i].subject;
+			} else if (j == 1) {
+				h = hits[i].pattern;
+			} else if (j == 2) {
+				h = hits[i].start;
+			} else if (j == 3) {
+				h = hits[i].end;
+			} else {
+				h = hits[i].dist;
+			}
+			for (h_i = 0; h_i < hits[i].n; h_i++)
+				*v++ = h[h_i];
+		}
+		SET_VECTOR_ELT(ans, j, col);
+		UNPROTECT(1);
+	}
+	
+	for (i = 0; i < nthreads; i++) {
+		free(hits[i].subject);
+		free(hits[i].pattern);
+		free(hits[i].start);
+		free(hits[i].end);
+		free(hits[i].dist);
+	}
+	Free(hits);
+	
+	UNPROTECT(1);
+	
+	return ans;
+}
@@ -0,0 +1,474 @@
+/****************************************************************************
+ *                        Read and Write Newick Trees                       *
+ *                           Author: Erik Wright                            *
+ ****************************************************************************/
+
+/*
+ * Rdefines.h is needed for the SEXP typedef, for the error(), INTEGER(),
+ * GET_DIM(), LOGICAL(), NEW_INTEGER(), PROTECT() and UNPROTECT() macros,
+ * and for the NA_INTEGER constant symbol.
+ */
+#include <Rdefines.h>
+
+/*
+ * R_ext/Rdynload.h is needed for the R_CallMethodDef typedef and the
+ * R_registerRoutines() prototype.
+ */
+#include <R_ext/Rdynload.h>
+
+/* for Calloc/Free */
+#include <R_ext/RS.h>
+
+// for math functions
+#include <math.h>
+
+// for strtod
+#include <stdlib.h>
+
+// for memcpy
+#include <string.h>
+
+// DECIPHER header file
+#include "DECIPHER.h"
+
+static int isDelim(const char c)
+{
+	switch (c) {
+		case '[':
+		case ']':
+		case '(':
+		case ')':
+		case ',':
+		case ':':
+		case ';':
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static int isBlank(const char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// convert a token to a number (NA if not numeric)
+static double getNumber(const char *s, int len)
+{
+	char *buf = Calloc(len + 1, char);
+	memcpy(buf, s, len);
+	buf[len] = '\0';
+	char *end;
+	double num = strtod(buf, &end);
+	if (end == buf || *end != '\0')
+		num = NA_REAL;
+	Free(buf);
+	return num;
+}
+
+// convert a token to a label
+static SEXP getLabel(const char *s, int len, char quote, int convertBlanks)
+{
+	int j, k = 0;
+	char *buf = Calloc(len + 1, char);
+	
+	if (len >= 2 && s[0] == quote && s[len - 1] == quote) {
+		// remove quotes and unescape doubled single quotes
+		for (j = 1; j < len - 1; j++) {
+			buf[k++] = s[j];
+			if (s[j] == '\'' && j + 1 < len - 1 && s[j + 1] == '\'')
+				j++;
+		}
+	} else {
+		// convert underscores to spaces in unquoted labels
+		for (j = 0; j < len; j++)
+			buf[k++] = (convertBlanks && s[j] == '_') ? ' ' : s[j];
+	}
+	
+	SEXP lab = mkCharLen(buf, k);
+	Free(buf);
+	return lab;
+}
+
+// parse a Newick string into flat arrays ordered by node appearance
+SEXP parseNewick(SEXP x, SEXP quoteChar, SEXP convertBlanks, SEXP internalLabels)
+{
+	int i, j, n;
+	const char *s = CHAR(STRING_ELT(x, 0));
+	int l = length(STRING_ELT(x, 0));
+	char quote = CHAR(STRING_ELT(quoteChar, 0))[0];
+	int cB = asLogical(convertBlanks);
+	int iL = asLogical(internalLabels);
+	
+	// split into tokens at delimiters outside of quotes
+	int size = 1000, nt = 0;
+	int *tStart = Calloc(size, int);
+	int *tLen = Calloc(size, int);
+	int inQuote = 0, begin = 0;
+	for (i = 0; i <= l; i++) {
+		if (i < l && s[i] == quote)
+			inQuote = !inQuote;
+		if (i == l || (!inQuote && isDelim(s[i]))) {
+			// add the preceding text then the delimiter
+			int b = begin, e = i;
+			while (b < e && isBlank(s[b]))
+				b++;
+			while (e > b && isBlank(s[e - 1]))
+				e--;
+			for (j = 0; j < 2; j++) {
+				if (j == 0 && e == b)
+					continue;
+				if (j == 1 && i == l)
+					break;
+				if (nt == size) {
+					size *= 2;
+					tStart = Realloc(tStart, size, int);
+					tLen = Realloc(tLen, size, int);
+				}
+				if (j == 0) {
+					tStart[nt] = b;
+					tLen[nt] = e - b;
+				} else {
+					tStart[nt] = i;
+					tLen[nt] = 1;
+				}
+				nt++;
+			}
+			begin = i + 1;
+		}
+	}
+	
+	#define TOK(k) (tLen[k] == 1 && isDelim(s[tStart[k]]) ? s[tStart[k]] : '\0')
+	
+	// nodes in order of appearance
+	size = 1000;
+	n = 0;
+	int *parent = Calloc(size, int);
+	double *len = Calloc(size, double);
+	int *labStart = Calloc(size, int);
+	int *labLen = Calloc(size, int);
+	int *leaf = Calloc(size, int);
+	int *stack = Calloc(size, int);
+	int depth = 0, closed = 0;
+	
+	#define FREE_NEWICK() \
+		Free(tStart); \
+		Free(tLen); \
+		Free(parent); \
+		Free(len); \
+		Free(labStart); \
+		Free(labLen); \
+		Free(leaf); \
+		Free(stack);
+	
+	#define NEW_NODE(isLeaf) \
+		if (n == size) { \
+			size *= 2; \
+			parent = Realloc(parent, size, int); \
+			len = Realloc(len, size, double); \
+			labStart = Realloc(labStart, size, int); \
+			labLen = Realloc(labLen, size, int); \
+			leaf = Realloc(leaf, size, int); \
+			stack = Realloc(stack, size, int); \
+		} \
+		parent[n] = (depth > 0) ? stack[depth - 1] + 1 : 0; \
+		len[n] = NA_REAL; \
+		labStart[n] = -1; \
+		labLen[n] = 0; \
+		leaf[n] = isLeaf; \
+		n++;
+	
+	i = 0;
+	while (i < nt && TOK(i) != ';' && !closed) {
+		if (TOK(i) == '[') { // comment
+			int count = 1;
+			i++;
+			while (count > 0) {
+				if (i >= nt) {
+					FREE_NEWICK();
+					error("Improperly formatted comment.");
+				}
+				if (TOK(i) == ']') {
+					count--;
+				} else if (TOK(i) == '[') {
+					count++;
+				}
+				i++;
+			}
+		} else if (TOK(i) == ')') {
+			if (depth == 0)
+				break;
+			j = stack[depth - 1];
+			i++;
+			if (i < nt && TOK(i) == ':') {
+				// internal node
+				i++;
+				if (i < nt)
+					len[j] = getNumber(s + tStart[i], tLen[i]);
+				i++;
+			} else if (i + 1 < nt && TOK(i + 1) == ':') {
+				// labeled internal node
+				if (iL) {
+					labStart[j] = tStart[i];
+					labLen[j] = tLen[i];
+				}
+				i += 2;
+				if (i < nt)
+					len[j] = getNumber(s + tStart[i], tLen[i]);
+				i++;
+			} else if (i + 1 < nt && TOK(i + 1) == ';') {
+				i++;
+			} else if (i < nt && TOK(i) != ';') {
+				break;
+			}
+			depth--;
+			if (depth == 0)
+				closed = 1;
+		} else if (TOK(i) == '(') {
+			NEW_NODE(0);
+			stack[depth++] = n - 1;
+			i++;
+		} else if (TOK(i) == ',') {
+			i++;
+		} else if (i + 2 < nt && TOK(i + 1) == ':' && depth > 0) {
+			NEW_NODE(1);
+			labStart[n - 1] = tStart[i];
+			labLen[n - 1] = tLen[i];
+			len[n - 1] = getNumber(s + tStart[i + 2], tLen[i + 2]);
+			i += 3;
+		} else if (i + 1 < nt && TOK(i) == ':' && depth > 0) {
+			NEW_NODE(1);
+			len[n - 1] = getNumber(s + tStart[i + 1], tLen[i + 1]);
+			i += 2;
+		} else {
+			break;
+		}
+	}
+	
+	if (!closed || n < 2) {
+		FREE_NEWICK();
+		error("Unsupported file formatting.");
+	}
+	
+	SEXP ans, P, L, LAB, LEAF, H, M, MID;
+	PROTECT(ans = allocVector(VECSXP, 7));
+	PROTECT(P = allocVector(INTSXP, n));
+	PROTECT(L = allocVector(REALSXP, n));
+	PROTECT(LAB = allocVector(STRSXP, n));
+	PROTECT(LEAF = allocVector(LGLSXP, n));
+	PROTECT(H = allocVector(REALSXP, n));
+	PROTECT(M = allocVector(INTSXP, n));
+	PROTECT(MID = allocVector(REALSXP, n));
+	int *p = INTEGER(P);
+	double *rl = REAL(L);
+	int *lf = LOGICAL(LEAF);
+	double *h = REAL(H);
+	int *m = INTEGER(M);
+	double *mid = REAL(MID);
+	
+	double maxH = 0;
+	double *A = Calloc(n, double); // midpoint terms known from siblings
+	int *acc = Calloc(n, int); // members accumulated in order
+	int *deg = Calloc(n, int); // number of children
+	for (i = 0; i < n; i++) {
+		p[i] = parent[i];
+		rl[i] = len[i];
+		lf[i] = leaf[i];
+		m[i] = leaf[i];
+		if (labStart[i] >= 0) {
+			SET_STRING_ELT(LAB, i, getLabel(s + labStart[i], labLen[i], quote, cB));
+		} else {
+			SET_STRING_ELT(LAB, i, mkChar(""));
+		}
+		
+		// distance from the root
+		if (i == 0) {
+			h[i] = 0;
+		} else {
+			h[i] = h[parent[i] - 1] + len[i];
+			if (leaf[i] && h[i] > maxH)
+				maxH = h[i];
+		}
+	}
+	
+	// count members from the tips toward the root
+	for (i = n - 1; i > 0; i--)
+		m[parent[i] - 1] += m[i];
+	
+	// midpoints follow the order of each node's children
+	for (i = 1; i < n; i++) {
+		j = parent[i] - 1;
+		deg[j]++;
+		if (leaf[i]) {
+			acc[j]++;
+			A[j] += acc[j];
+		} else {
+			A[j] += acc[j] + 1;
+			acc[j] += m[i];
+		}
+	}
+	for (i = n - 1; i >= 0; i--) {
+		if (leaf[i]) {
+			mid[i] = NA_REAL;
+		} else {
+			mid[i] = A[i]/deg[i] - 1;
+			if (i > 0) // add to parent
+				A[parent[i] - 1] += mid[i];
+		}
+	}
+	for (i = 0; i < n; i++)
+		h[i] = maxH - h[i];
+	
+	Free(A);
+	Free(acc);
+	Free(deg);
+	FREE_NEWICK();
+	
+	SET_VECTOR_ELT(ans, 0, P);
+	SET_VECTOR_ELT(ans, 1, L);
+	SET_VECTOR_ELT(ans, 2, LAB);
+	SET_VECTOR_ELT(ans, 3, LEAF);
+	SET_VECTOR_ELT(ans, 4, H);
+	SET_VECTOR_ELT(ans, 5, M);
+	SET_VECTOR_ELT(ans, 6, MID);
+	
+	UNPROTECT(8);
+	
+	return ans;
+}
+
+// append text to a growing character buffer
+static void append(char **buf, int *len, int *size, const char *text, int n)
+{
+	if (*len + n + 1 > *size) {
+		while (*len + n + 1 > *size)
+			*size *= 2;
+		*buf = Realloc(*buf, *size, char);
+	}
+	memcpy(*buf + *len, text, n);
+	*len += n;
+}
+
+static void appendLabel(char **buf, int *len, int *size, SEXP lab, char quote, char space)
+{
+	int j;
+	if (lab == R_NilValue)
+		return;
+	const char *s = CHAR(asChar(lab));
+	int n = strlen(s);
+	char c;
+	
+	if (quote != '\0')
+		append(buf, len, size, &quote, 1);
+	for (j = 0; j < n; j++) {
+		c = s[j];
+		if (c == ' ') {
+			c = space;
+		} else if (quote != '\0' && c == quote) {
+			c = '_';
+		}
+		append(buf, len, size, &c, 1);
+	}
+	if (quote != '\0')
+		append(buf, len, size, &quote, 1);
+}
+
+// round to digits after the decimal and print with sig significant digits like cat()
+static void appendLength(char **buf, int *len, int *size, double x, double digits, int sig)
+{
+	char num[64];
+	double p = pow(10, digits);
+	x = round(x*p)/p;
+	if (x == 0) // avoid negative zero
+		x = 0;
+	int n = snprintf(num, 64, ":%.*g", sig, x);
+	append(buf, len, size, num, n);
+}
+
+static int isLeaf(SEXP x)
+{
+	SEXP leaf = getAttrib(x, install("leaf"));
+	return TYPEOF(leaf) == LGLSXP && length(leaf) > 0 && LOGICAL(leaf)[0] == 1;
+}
+
+static double getHeight(SEXP x)
+{
+	SEXP height = getAttrib(x, install("height"));
+	if (height == R_NilValue)
+		return 0;
+	return asReal(height);
+}
+
+// write a dendrogram in Newick format without recursion
+SEXP writeNewick(SEXP x, SEXP quoteChar, SEXP spaceChar, SEXP internalLabels, SEXP digits, SEXP sigDigits)
+{
+	const char *q = CHAR(STRING_ELT(quoteChar, 0));
+	char quote = q[0];
+	char space = CHAR(STRING_ELT(spaceChar, 0))[0];
+	int iL = asLogical(internalLabels);
+	double d = asReal(digits);
+	int sig = asInteger(sigDigits);
+	SEXP label = install("label");
+	SEXP edgetext = install("edgetext");
+	
+	int size = 1000, len = 0;
+	char *buf = Calloc(size, char);
+	
+	if (isLeaf(x)) {
+		appendLabel(&buf, &len, &size, getAttrib(x, label), quote, space);
+		appendLength(&buf, &len, &size, 0, d, sig);
+	} else {
+		int depth = 0, stackSize = 100;
+		SEXP *nodes = Calloc(stackSize, SEXP);
+		int *index = Calloc(stackSize, int);
+		nodes[0] = x;
+		index[0] = 0;
+		append(&buf, &len, &size, "(", 1);
+		
+		while (depth >= 0) {
+			SEXP node = nodes[depth];
+			if (index[depth] < length(node)) {
+				if (index[depth] > 0)
+					append(&buf, &len, &size, ",", 1);
+				SEXP child = VECTOR_ELT(node, index[depth]);
+				index[depth]++;
+				if (isLeaf(child)) {
+					appendLabel(&buf, &len, &size, getAttrib(child, label), quote, space);
+					appendLength(&buf, &len, &size, getHeight(node) - getHeight(child), d, sig);
+				} else {
+					append(&buf, &len, &size, "(", 1);
+					depth++;
+					if (depth == stackSize) {
+						stackSize *= 2;
+						nodes = Realloc(nodes, stackSize, SEXP);
+						index = Realloc(index, stackSize, int);
+					}
+					nodes[depth] = child;
+					index[depth] = 0;
+				}
+			} else {
+				depth--;
+				if (depth < 0) {
+					append(&buf, &len, &size, ");\n", 3);
+				} else {
+					append(&buf, &len, &size, ")", 1);
+					if (iL)
+						appendLabel(&buf, &len, &size, getAttrib(node, edgetext), quote, space);
+					appendLength(&buf, &len, &size, getHeight(nodes[depth]) - getHeight(node), d, sig);
+				}
+			}
+		}
+		
+		Free(nodes);
+		Free(index);
+	}
+	
+	SEXP ans;
+	PROTECT(ans = allocVector(STRSXP, 1));
+	SET_STRING_ELT(ans, 0, mkCharLen(buf, len));
+	Free(buf);
+	
+	UNPROTECT(1);
+	
+	return ans;
+}
@@ -36,12 +36,32 @@
 // strcpy
 #include <string.h>
 
-// for time and difftime
-#include <time.h>
-
 // DECIPHER header file
 #include "DECIPHER.h"
 
+#define MAX_DP_CELLS 134217728 // larger regions in alignPair are aligned within a band
+#define MIN_BAND_WIDTH 1000 // rows on either side of the diagonal when banded
+#define NEG_SCORE -1073741824 // score of cells outside the band
+#define MAX_BAND_GROWTH 4 // adaptive bands widen up to this multiple of bandWidth
+
+// traceback directions in alignPair
+#define DIAGONAL 0
+#define UP 1
+#define LEFT 2
+
+static inline void setDirection(unsigned char *tb, size_t k, int d)
+{
+	tb[k >> 2] |= d << ((k & 3) << 1);
+}
+
+static inline int getDirection(const unsigned char *tb, const int *lo, const int *hi, const size_t *col, int i, int j)
+{
+	if (i < lo[j] || i > hi[j])
+		return DIAGONAL; // outside the band
+	size_t k = col[j] + i - lo[j];
+	return (tb[k >> 2] >> ((k & 3) << 1)) & 3;
+}
+
 static void integerEncode(const Chars_holder *P, int start, int end, int* v)
 {
 	int i, j;
@@ -255,123 +275,151 @@ SEXP alignPair(SEXP x, SEXP y, SEXP s1, SEXP e1, SEXP s2, SEXP e2, SEXP go, SEXP
 			integerEncode(&Y, S2[i] - 1, E2[i] - 1, v2);
 		}
 		
-		int *index = (int *) malloc((l2 + 1)*sizeof(int));
-		for (i1 = 0; i1 <= l2; i1++)
-			index[i1] = i1*(l1 + 1);
+		// determine the rows of each column that are filled
+		int *lo = (int *) malloc((l2 + 1)*sizeof(int)); // thread-safe on Windows
+		int *hi = (int *) malloc((l2 + 1)*sizeof(int)); // thread-safe on Windows
+		size_t *col = (size_t *) malloc((l2 + 2)*sizeof(size_t)); // thread-safe on Windows
+		int w = -1; // band half-width (-1 for the full matrix)
+		double slope = 0;
+		if (l1 > 0 && l2 > 0 &&
+			(double)(l1 + 1)*(double)(l2 + 1) > MAX_DP_CELLS) {
+			w = (int)((MAX_DP_CELLS - l1 - 1)/(2*(double)(l2 + 1)));
+			if (w < MIN_BAND_WIDTH)
+				w = MIN_BAND_WIDTH;
+			slope = (double)l1/(double)l2;
+		}
+		col[0] = 0;
+		for (j1 = 0; j1 <= l2; j1++) {
+			if (w < 0) {
+				lo[j1] = 0;
+				hi[j1] = l1;
+			} else { // follow the diagonal from corner to corner
+				lo[j1] = (int)(j1*slope) - w;
+				if (lo[j1] < 0)
+					lo[j1] = 0;
+				hi[j1] = (int)((j1 + 1)*slope) + w;
+				if (hi[j1] > l1)
+					hi[j1] = l1;
+			}
+			col[j1 + 1] = col[j1] + hi[j1] - lo[j1] + 1;
+		}
 		
-		// initialize matrix
-		int *m = (int *) malloc((l1 + 1)*(l2 + 1)*sizeof(int)); // thread-safe on Windows
-		int *o = (int *) malloc((l1 + 1)*(l2 + 1)*sizeof(int)); // thread-safe on Windows
-		m[0] = 0;
-		o[0] = 0;
+		// traceback directions at two bits per cell
+		unsigned char *tb = (unsigned char *) calloc((col[l2 + 1] + 3)/4, sizeof(unsigned char)); // initialized to zero (thread-safe on Windows)
 		
-		// fill gap opening at beginning
-		if (i == 0) {
-			i1 = 0;
-			j1 = 1;
-			while (j1 <= l2) {
-				m[i1 + index[j1]] = TG;
-				o[i1 + index[j1]] = j1;
-				j1++;
-			}
-			i1 = 1;
-			j1 = 0;
-			while (i1 <= l1) {
-				m[i1 + index[j1]] = TG;
-				o[i1 + index[j1]] = -1*i1;
-				i1++;
-			}
-		} else {
-			i1 = 0;
-			j1 = 1;
-			i2 = GO;
-			while (j1 <= l2) {
-				i2 += GE;
-				m[i1 + index[j1]] = i2;
-				o[i1 + index[j1]] = j1;
-				j1++;
-			}
-			i1 = 1;
-			j1 = 0;
-			j2 = GO;
-			while (i1 <= l1) {
-				j2 += GE;
-				m[i1 + index[j1]] = j2;
-				o[i1 + index[j1]] = -1*i1;
-				i1++;
-			}
+		// scores and gap lengths of the previous and current column
+		int *m0 = (int *) malloc((l1 + 1)*sizeof(int)); // thread-safe on Windows
+		int *m1 = (int *) malloc((l1 + 1)*sizeof(int)); // thread-safe on Windows
+		int *o0 = (int *) malloc((l1 + 1)*sizeof(int)); // thread-safe on Windows
+		int *o1 = (int *) malloc((l1 + 1)*sizeof(int)); // thread-safe on Windows
+		int *lastRow = (int *) malloc((l2 + 1)*sizeof(int)); // thread-safe on Windows
+		for (i1 = 0; i1 <= l1; i1++) {
+			m0[i1] = NEG_SCORE;
+			m1[i1] = NEG_SCORE;
+			o0[i1] = 0;
+			o1[i1] = 0;
+		}
+		
+		// initialize the first column
+		m0[0] = 0;
+		for (i1 = 1; i1 <= hi[0]; i1++) {
+			m0[i1] = (i == 0) ? TG : GO + i1*GE;
+			o0[i1] = -1*i1;
+			setDirection(tb, col[0] + i1, UP);
 		}
+		lastRow[0] = (hi[0] == l1) ? m0[l1] : NEG_SCORE;
 		
 		j2 = 1;
 		j1 = 0;
 		int uGaps, lGaps;
+		int *mp = m0, *op = o0, *mc = m1, *oc = o1, *swap;
 		while (j2 <= l2) {
-			i2 = 1;
-			i1 = 0;
-			while (i2 <= l1) {
-				d = m[i1 + index[j1]] + SM[v1[i1] + square[v2[j1]]];
-				if (o[i1 + index[j2]] < 0) {
-					u = m[i1 + index[j2]] + GE;
-					uGaps = o[i1 + index[j2]] - 1;
+			if (j2 > 1) { // clear the column held two columns ago
+				for (i1 = lo[j2 - 2]; i1 <= hi[j2 - 2]; i1++) {
+					mc[i1] = NEG_SCORE;
+					oc[i1] = 0;
+				}
+			}
+			
+			// fill gap opening at beginning
+			if (lo[j2] == 0) {
+				mc[0] = (i == 0) ? TG : GO + j2*GE;
+				oc[0] = j2;
+				setDirection(tb, col[j2], LEFT);
+			}
+			
+			i2 = (lo[j2] > 1) ? lo[j2] : 1;
+			i1 = i2 - 1;
+			while (i2 <= hi[j2]) {
+				d = mp[i1] + SM[v1[i1] + square[v2[j1]]];
+				if (oc[i1] < 0) {
+					u = mc[i1] + GE;
+					uGaps = oc[i1] - 1;
 				} else {
-					u = m[i1 + index[j2]] + GB;
+					u = mc[i1] + GB;
 					uGaps = -1;
 				}
-				if (o[i2 + index[j1]] > 0) {
-					l = m[i2 + index[j1]] + GE;
-					lGaps = o[i2 + index[j1]] + 1;
+				if (op[i2] > 0) {
+					l = mp[i2] + GE;
+					lGaps = op[i2] + 1;
 				} else {
-					l = m[i2 + index[j1]] + GB;
+					l = mp[i2] + GB;
 					lGaps = 1;
 				}
 				if (d >= u && d >= l) { // diagonal
-					o[i2 + index[j2]] = 0;
-					m[i2 + index[j2]] = d;
+					oc[i2] = 0;
+					mc[i2] = d;
 				} else if (u >= l) { // up
-					o[i2 + index[j2]] = uGaps;
-					m[i2 + index[j2]] = u;
+					oc[i2] = uGaps;
+					mc[i2] = u;
+					setDirection(tb, col[j2] + i2 - lo[j2], UP);
 				} else { // left
-					o[i2 + index[j2]] = lGaps;
-					m[i2 + index[j2]] = l;
+					oc[i2] = lGaps;
+					mc[i2] = l;
+					setDirection(tb, col[j2] + i2 - lo[j2], LEFT);
 				}
 				i1 = i2;
 				i2++;
 			}
+			lastRow[j2] = (hi[j2] == l1) ? mc[l1] : NEG_SCORE;
+			
+			swap = mp;
+			mp = mc;
+			mc = swap;
+			swap = op;
+			op = oc;
+			oc = swap;
 			j1 = j2;
 			j2++;
 		}
 		free(v1);
 		free(v2);
 		
-		// fill gap closing at end
+		// fill gap closing at end of the last column (mp) and last row
 		if (i == n - 1) {
 			i1 = l1 - 1;
-			// j1 == l2
 			while (i1 >= 0) {
-				m[i1 + index[j1]] += TG;
+				mp[i1] += TG;
 				i1--;
 			}
-			i1 = l1;
 			j1 = l2 - 1;
 			while (j1 >= 0) {
-				m[i1 + index[j1]] += TG;
+				lastRow[j1] += TG;
 				j1--;
 			}
 		} else {
 			i1 = l1 - 1;
-			j1 = l2;
 			i2 = GO;
 			while (i1 >= 0) {
 				i2 += GE;
-				m[i1 + index[j1]] += i2;
+				mp[i1] += i2;
 				i1--;
 			}
-			i1 = l1;
 			j1 = l2 - 1;
 			j2 = GO;
 			while (j1 >= 0) {
 				j2 += GE;
-				m[i1 + index[j1]] += j2;
+				lastRow[j1] += j2;
 				j1--;
 			}
 		}
@@ -379,29 +427,33 @@ SEXP alignPair(SEXP x, SEXP y, SEXP s1, SEXP e1, SEXP s2, SEXP e2, SEXP go, SEXP
 		// find the maximum score
 		i2 = l1;
 		j2 = l2;
+		d = mp[l1];
 		if (l2 > 0) {
 			i1 = l1 - 1;
-			j1 = l2;
 			while (i1 >= 0) {
-				if (m[i1 + index[j1]] > m[i2 + index[j2]]) {
+				if (mp[i1] > d) {
+					d = mp[i1];
 					i2 = i1;
-					j2 = j1;
 				}
 				i1--;
 			}
 		}
 		if (l1 > 0) {
-			i1 = l1;
 			j1 = l2 - 1;
 			while (j1 >= 0) {
-				if (m[i1 + index[j1]] > m[i2 + index[j2]]) {
-					i2 = i1;
+				if (lastRow[j1] > d) {
+					d = lastRow[j1];
+					i2 = l1;
 					j2 = j1;
 				}
 				j1--;
 			}
 		}
-		free(m);
+		free(m0);
+		free(m1);
+		free(o0);
+		free(o1);
+		free(lastRow);
 		
 		i1 = i2;
 		j1 = j2;
@@ -413,15 +465,20 @@ SEXP alignPair(SEXP x, SEXP y, SEXP s1, SEXP e1, SEXP s2, SEXP e2, SEXP go, SEXP
 			N1[i]++;
 		}
 		while (i2 >= 0 && j2 >= 0) {
-			if (o[i2 + index[j2]] == 0) {
+			d = getDirection(tb, lo, hi, col, i2, j2);
+			if (d == DIAGONAL) {
 				i2--;
 				j2--;
-			} else if (o[i2 + index[j2]] > 0) {
+			} else if (d == LEFT) {
 				N2[i]++;
-				j2 -= o[i2 + index[j2]];
+				do { // skip the run of gaps
+					j2--;
+				} while (j2 >= 0 && getDirection(tb, lo, hi, col, i2, j2) == LEFT);
 			} else {
 				N1[i]++;
-				i2 += o[i2 + index[j2]];
+				do { // skip the run of gaps
+					i2--;
+				} while (i2 >= 0 && getDirection(tb, lo, hi, col, i2, j2) == UP);
 			}
 		}
 		
@@ -451,19 +508,26 @@ SEXP alignPair(SEXP x, SEXP y, SEXP s1, SEXP e1, SEXP s2, SEXP e2, SEXP go, SEXP
 				N1[i]++;
 			}
 			while (i2 >= 0 && j2 >= 0) {
-				if (o[i2 + index[j2]] == 0) {
+				d = getDirection(tb, lo, hi, col, i2, j2);
+				if (d == DIAGONAL) {
 					i2--;
 					j2--;
-				} else if (o[i2 + index[j2]] > 0) {
+				} else if (d == LEFT) {
 					p3[N2[i]] = i2;
-					p4[N2[i]] = o[i2 + index[j2]];
+					p4[N2[i]] = 0;
+					do { // measure the run of gaps
+						p4[N2[i]]++;
+						j2--;
+					} while (j2 >= 0 && getDirection(tb, lo, hi, col, i2, j2) == LEFT);
 					N2[i]++;
-					j2 -= o[i2 + index[j2]];
 				} else {
 					p1[N1[i]] = j2;
-					p2[N1[i]] = -1*o[i2 + index[j2]];
+					p2[N1[i]] = 0;
+					do { // measure the run of gaps
+						p2[N1[i]]++;
+						i2--;
+					} while (i2 >= 0 && getDirection(tb, lo, hi, col, i2, j2) == UP);
 					N1[i]++;
-					i2 += o[i2 + index[j2]];
 				}
 			}
 			
@@ -477,8 +541,10 @@ SEXP alignPair(SEXP x, SEXP y, SEXP s1, SEXP e1, SEXP s2, SEXP e2, SEXP go, SEXP
 			}
 		}
 		
-		free(o);
-		free(index);
+		free(tb);
+		free(lo);
+		free(hi);
+		free(col);
 	}
 	free(square);
 	
@@ -617,7 +683,126 @@ SEXP alignPair(SEXP x, SEXP y, SEXP s1, SEXP e1, SEXP s2, SEXP e2, SEXP go, SEXP
 	return ans;
 }
 
-static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1, int pos2, int l1, int l2, int anchor, int bandWidth, double GO, double GE, double dropScore, double *subMatrix, int *lkup_row, int *lkup_col, int *results, int **indels1, int **lengths1, int **indels2, int **lengths2)
+// trace back from the maximum through the matrix of directions (o),
+// which has the start of each diagonal at slot
+static void tracebackRegion(const int *o, int size, int slot, int anchor, int pos1, int pos2, int l1, int l2, int M1, int M2, int C1, int C2, int *results, int **indels1, int **lengths1, int **indels2, int **lengths2)
+{
+	int i, temp;
+	int m1 = M1; // position of max in sequence 1
+	int m2 = M2; // position of max in sequence 2
+	int c1 = C1 + 1; // position of max in diagonal
+	int c2 = C2 + 1; // max diagonal
+	int count1 = 0; // number of indels
+	int max_count1 = 1; // max number of indels (>= 1)
+	int count2 = 0; // number of indels
+	int max_count2 = 1; // max number of indels (>= 1)
+	*indels1 = (int *) malloc(max_count1*sizeof(int)); // thread-safe on Windows
+	*lengths1 = (int *) malloc(max_count1*sizeof(int)); // thread-safe on Windows
+	*indels2 = (int *) malloc(max_count2*sizeof(int)); // thread-safe on Windows
+	*lengths2 = (int *) malloc(max_count2*sizeof(int)); // thread-safe on Windows
+	int *ind1 = indels1[0];
+	int *len1 = lengths1[0];
+	int *ind2 = indels2[0];
+	int *len2 = lengths2[0];
+	int end1, end2;
+	if (anchor == 0 || anchor == 2) {
+		end1 = l1;
+		end2 = l2;
+		if (m1 < l1) {
+			ind2[count2] = l2 - pos2 + 2; // relative to pos2
+			len2[count2++] = l1 - m1;
+		}
+		if (m2 < l2) {
+			ind1[count1] = l1 - pos1 + 2; // relative to pos1
+			len1[count1++] = l2 - m2;
+		}
+	} else { // only one anchor
+		end1 = m1;
+		end2 = m2;
+	}
+	while (m1 >= pos1 && m2 >= pos2) {
+		if (o[c1 - 1 + size*(c2 - 1)] == 0) { // across
+			c1 += o[slot + size*(c2 - 1)];
+			c2 -= 2; // shift two diagonals left
+			if (c2 >= 1) // still within bounds
+				c1 -= o[slot + size*(c2 - 1)] + 1;
+			m1--;
+			m2--;
+		} else if (o[c1 - 1 + size*(c2 - 1)] > 0) { // up
+			if (count2 == max_count2) {
+				max_count2 *= 2;
+				*indels2 = (int *) realloc(*indels2, max_count2*sizeof(int)); // thread-safe on Windows
+				*lengths2 = (int *) realloc(*lengths2, max_count2*sizeof(int)); // thread-safe on Windows
+				ind2 = indels2[0];
+				len2 = lengths2[0];
+			}
+			ind2[count2] = m2 + 2 - pos2;
+			len2[count2++] = o[c1 - 1 + size*(c2 - 1)];
+			m1 -= o[c1 - 1 + size*(c2 - 1)];
+			temp = o[slot + size*(c2 - 1)] + c1 - o[c1 - 1 + size*(c2 - 1)];
+			c2 -= o[c1 - 1 + size*(c2 - 1)];
+			c1 = temp;
+			if (c2 >= 1) // still within bounds
+				c1 -= o[slot + size*(c2 - 1)];
+		} else { // left
+			if (count1 == max_count1) {
+				max_count1 *= 2;
+				*indels1 = (int *) realloc(*indels1, max_count1*sizeof(int)); // thread-safe on Windows
+				*lengths1 = (int *) realloc(*lengths1, max_count1*sizeof(int)); // thread-safe on Windows
+				ind1 = indels1[0];
+				len1 = lengths1[0];
+			}
+			ind1[count1] = m1 + 2 - pos1;
+			len1[count1++] = -1*o[c1 - 1 + size*(c2 - 1)];
+			m2 += o[c1 - 1 + size*(c2 - 1)];
+			temp = o[slot + size*(c2 - 1)] + c1;
+			c2 += o[c1 - 1 + size*(c2 - 1)];
+			c1 = temp;
+			if (c2 >= 1) // still within bounds
+				c1 -= o[slot + size*(c2 - 1)];
+		}
+	}
+	if (m1 >= pos1) {
+		if (count2 == max_count2) {
+			max_count2++;
+			*indels2 = (int *) realloc(*indels2, max_count2*sizeof(int)); // thread-safe on Windows
+			*lengths2 = (int *) realloc(*lengths2, max_count2*sizeof(int)); // thread-safe on Windows
+			ind2 = indels2[0];
+			len2 = lengths2[0];
+		}
+		ind2[count2] = 1; // relative to pos2
+		len2[count2++] = m1 - pos1 + 1;
+	}
+	if (m2 >= pos2) {
+		if (count1 == max_count1) {
+			max_count1++;
+			*indels1 = (int *) realloc(*indels1, max_count1*sizeof(int)); // thread-safe on Windows
+			*lengths1 = (int *) realloc(*lengths1, max_count1*sizeof(int)); // thread-safe on Windows
+			ind1 = indels1[0];
+			len1 = lengths1[0];
+		}
+		ind1[count1] = 1; // relative to pos1
+		len1[count1++] = m2 - pos2 + 1;
+	}
+	if (anchor == -1) { // make positions relative to end
+		for (i = 0; i < count1; i++)
+			ind1[i] = end1 - pos1 - ind1[i] + 3;
+		for (i = 0; i < count2; i++)
+			ind2[i] = end2 - pos2 - ind2[i] + 3;
+		pos1 = l1 - end1 + 1;
+		pos2 = l2 - end2 + 1;
+		end1 = l1;
+		end2 = l2;
+	}
+	results[0] = count1;
+	results[1] = count2;
+	results[2] = pos1;
+	results[3] = end1;
+	results[4] = pos2;
+	results[5] = end2;
+}
+
+static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1, int pos2, int l1, int l2, int anchor, int bandWidth, int adaptive, double GO, double GE, double dropScore, double *subMatrix, int *lkup_row, int *lkup_col, int *results, int **indels1, int **lengths1, int **indels2, int **lengths2, double *nCells, int *nExpansions)
 {
 	// s1: pointer to pattern sequence
 	// s2: pointer to subject sequence
@@ -627,22 +812,30 @@ static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1,
 	// l2: number of positions to align in subject
 	// anchor: 0 = global without terminal gap penalties; +/- 1 = local (+ = anchored at left side, - = anchored at right side); 2 = global with terminal gap penalties
 	// bandWidth: width of adaptive band around max score in alignment matrix
+	// adaptive: 0 = fixed bandWidth; 1 = resize the band on each diagonal
 	// GO: gap opening penalty
 	// GE: (affine) gap extension penalty
 	// dropScore: discontinue extension when score decreases by dropScore (applicable when anchor = +/- 1)
 	// subMatrix: (square) substitution matrix
 	// lkup_row: vector to convert characters to row indices in substitution matrix
 	// lkup_col: vector to convert characters to column indices in substitution matrix
+	// nCells: incremented by the number of scored positions
+	// nExpansions: incremented by the number of times the band widened
 	
 	// initialize variables
 	int i, c1, c2, p1, p2, count, max_count, temp;
 	double score, subScore;
+	double cells = 0; // number of scored positions
+	int expansions = 0; // number of times the band widened
 	int I, J; // value at a sequence position
 	const char *p, *s; // pattern and subject pointers
 	p = s1->ptr - 1; // pointer to initial position in pattern
 	s = s2->ptr - 1; // pointer to initial position in subject
 	
 	// determine allowable bandWidth
+	int width = bandWidth; // width of the band on the current diagonal
+	if (adaptive)
+		bandWidth *= MAX_BAND_GROWTH; // widest band
 	if (l1 - pos1 + 1 < bandWidth)
 		bandWidth = l1 - pos1 + 1;
 	if (l2 - pos2 + 1 < bandWidth)
@@ -651,12 +844,22 @@ static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1,
 		bandWidth = 4; // minimum bandWidth
 	if (bandWidth % 2 == 1)
 		bandWidth++; // bandWidth must be an even number
+	if (width > bandWidth)
+		width = bandWidth;
+	if (width % 2 == 1)
+		width++; // width must be an even number
+	int narrowest = width/4; // narrowest adaptive band
+	if (narrowest < 4)
+		narrowest = 4;
+	if (narrowest % 2 == 1)
+		narrowest++;
 	
 	// initialize size variables
-	int half = bandWidth/2; // bandWidth is even so half stays even
+	int half; // half of the width
 	int tot = l1 - pos1 + l2 - pos2 + 1; // maximum number of diagonals
 	int diags; // columns in initial alignment matrix
-	int size = bandWidth + 2; // number of rows in o
+	int slot = width; // rows of o available to the band
+	int size = slot + 2; // number of rows in o
 	if (anchor == 0 || anchor == 2) {
 		diags = tot; // initialize to maximum number of possible diagonals
 	} else {
@@ -692,7 +895,7 @@ static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1,
 	}
 	m[0] = subMatrix[I + J];
 	
-	// initialize traceback matrix [(bandWidth + 2 rows) x (diags columns)]
+	// initialize traceback matrix [(slot + 2 rows) x (diags columns)]
 	int *o = (int *) malloc(size*diags*sizeof(int)); // thread-safe on Windows
 	
 	// initialize variables for looping
@@ -724,10 +927,11 @@ static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1,
 		}
 		
 		// initialize location
+		half = width/2;
 		c1 = m1 - half; // current position in first sequence
 		c2 = m2 + half; // current position in second sequence
-		if (c1 + bandWidth > l1) {
-			temp = l1 - bandWidth - c1;
+		if (c1 + width > l1) {
+			temp = l1 - width - c1;
 			c2 -= temp;
 			c1 += temp;
 		}
@@ -739,13 +943,13 @@ static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1,
 			c1 = c1 - l2 + c2;
 			c2 = l2;
 		}
-		o[bandWidth + size*diagonal] = c1; // record starting position
+		o[slot + size*diagonal] = c1; // record starting position
 		
 		// calculate relative positions in previous diagonals
 		if (diagonal > 0) {
-			p1 = c1 - o[bandWidth + size*(diagonal - 1)]; // one diagonal ago
+			p1 = c1 - o[slot + size*(diagonal - 1)]; // one diagonal ago
 			if (diagonal > 1) {
-				p2 = c1 - o[bandWidth + size*(diagonal - 2)]; // two diagonals ago
+				p2 = c1 - o[slot + size*(diagonal - 2)]; // two diagonals ago
 			} else {
 				p2 = -1*bandWidth - 1;
 			}
@@ -761,7 +965,7 @@ static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1,
 		max_count = 0;
 		while (c1 <= l1 && // within bounds of pattern
 			c2 >= pos2 && // within bounds of subject
-			count < bandWidth - 1) { // within bandWidth
+			count < width - 1) { // within width
 			count++; // next position
 			o[count + size*diagonal] = 0; // initialize to across
 			
@@ -796,7 +1000,7 @@ static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1,
 			subScore = subMatrix[I + J];
 			
 			// compute score for adding a gap in the subject
-			if (p1 >= 1 && p1 <= o[bandWidth + 1 + size*(diagonal - 1)]) { // up
+			if (p1 >= 1 && p1 <= o[slot + 1 + size*(diagonal - 1)]) { // up
 				if (anchor == 0 && c2 == pos2) { // at edge without terminal gap penalties
 					m[count + bandWidth*col0] = subScore;
 				} else {
@@ -819,7 +1023,7 @@ static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1,
 			p1++;
 			
 			// compute score for adding a gap in the pattern
-			if (p1 >= 1 && p1 <= o[bandWidth + 1 + size*(diagonal - 1)]) { // left
+			if (p1 >= 1 && p1 <= o[slot + 1 + size*(diagonal - 1)]) { // left
 				if (anchor == 0 && c1 == pos1) { // at edge without terminal gap penalties
 					m[count + bandWidth*col0] = subScore;
 				} else {
@@ -841,7 +1045,7 @@ static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1,
 			}
 			
 			// compare with score for aligning positions
-			if (p2 >= 1 && p2 <= o[bandWidth + 1 + size*(diagonal - 2)]) { // across
+			if (p2 >= 1 && p2 <= o[slot + 1 + size*(diagonal - 2)]) { // across
 				subScore += m[p2 - 1 + bandWidth*col2];
 				if (subScore > m[count + bandWidth*col0]) {
 					m[count + bandWidth*col0] = subScore;
@@ -881,7 +1085,45 @@ static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1,
 			c1++;
 			c2--;
 		}
-		o[bandWidth + 1 + size*diagonal] = count + 1; // record diagonal length
+		o[slot + 1 + size*diagonal] = count + 1; // record diagonal length
+		cells += count + 1;
+		
+		// resize the band from the scores across a full diagonal
+		if (adaptive && count + 1 == width) {
+			score = m[max_count + bandWidth*col0];
+			temp = width/4; // positions near either edge
+			if (temp < 1)
+				temp = 1;
+			if (max_count < temp || // max drifting toward an edge
+				max_count > count - temp ||
+				m[bandWidth*col0] >= score + GO || // competitive edge
+				m[count + bandWidth*col0] >= score + GO) {
+				if (width < bandWidth) {
+					width *= 2;
+					if (width > bandWidth)
+						width = bandWidth;
+					expansions++;
+					
+					if (width > slot) { // widen the traceback matrix
+						int wider = width + 2; // rows after widening
+						o = (int *) realloc(o, wider*diags*sizeof(int)); // thread-safe on Windows
+						for (i = diagonal; i >= 0; i--) { // shift columns from the last
+							int start = o[slot + size*i];
+							int length = o[slot + 1 + size*i];
+							memmove(o + wider*i, o + size*i, length*sizeof(int));
+							o[width + wider*i] = start;
+							o[width + 1 + wider*i] = length;
+						}
+						slot = width;
+						size = wider;
+					}
+				}
+			} else if (m[bandWidth*col0] < score + 3*GO && // both edges far below max
+				m[count + bandWidth*col0] < score + 3*GO &&
+				width > narrowest) {
+				width -= 2;
+			}
+		}
 		
 		// rotate columns in the score matrix
 		temp = col0;
@@ -899,513 +1141,260 @@ static int alignRegion(const Chars_holder *s1, const Chars_holder *s2, int pos1,
 		}
 	}
 	free(m);
+	COUNT(COUNT_DP_CELLS, cells);
+	COUNT(COUNT_BAND_EXPANSIONS, expansions);
+	*nCells += cells;
+	*nExpansions += expansions;
 	
 	// perform traceback
-	m1 = M1; // position of max in sequence 1
-	m2 = M2; // position of max in sequence 2
-	c1 = C1 + 1; // position of max in diagonal
-	c2 = C2 + 1; // max diagonal
-	int count1 = 0; // number of indels
-	int max_count1 = 1; // max number of indels (>= 1)
-	int count2 = 0; // number of indels
-	int max_count2 = 1; // max number of indels (>= 1)
-	*indels1 = (int *) malloc(max_count1*sizeof(int)); // thread-safe on Windows
-	*lengths1 = (int *) malloc(max_count1*sizeof(int)); // thread-safe on Windows
-	*indels2 = (int *) malloc(max_count2*sizeof(int)); // thread-safe on Windows
-	*lengths2 = (int *) malloc(max_count2*sizeof(int)); // thread-safe on Windows
-	int *ind1 = indels1[0];
-	int *len1 = lengths1[0];
-	int *ind2 = indels2[0];
-	int *len2 = lengths2[0];
-	int end1, end2;
-	if (anchor == 0 || anchor == 2) {
-		end1 = l1;
-		end2 = l2;
-		if (m1 < l1) {
-			ind2[count2] = l2 - pos2 + 2; // relative to pos2
-			len2[count2++] = l1 - m1;
-		}
-		if (m2 < l2) {
-			ind1[count1] = l1 - pos1 + 2; // relative to pos1
-			len1[count1++] = l2 - m2;
-		}
-	} else { // only one anchor
-		end1 = m1;
-		end2 = m2;
-	}
-	while (m1 >= pos1 && m2 >= pos2) {
-		if (o[c1 - 1 + size*(c2 - 1)] == 0) { // across
-			c1 += o[bandWidth + size*(c2 - 1)];
-			c2 -= 2; // shift two diagonals left
-			if (c2 >= 1) // still within bounds
-				c1 -= o[bandWidth + size*(c2 - 1)] + 1;
-			m1--;
-			m2--;
-		} else if (o[c1 - 1 + size*(c2 - 1)] > 0) { // up
-			if (count2 == max_count2) {
-				max_count2 *= 2;
-				*indels2 = (int *) realloc(*indels2, max_count2*sizeof(int)); // thread-safe on Windows
-				*lengths2 = (int *) realloc(*lengths2, max_count2*sizeof(int)); // thread-safe on Windows
-				ind2 = indels2[0];
-				len2 = lengths2[0];
-			}
-			ind2[count2] = m2 + 2 - pos2;
-			len2[count2++] = o[c1 - 1 + size*(c2 - 1)];
-			m1 -= o[c1 - 1 + size*(c2 - 1)];
-			temp = o[bandWidth + size*(c2 - 1)] + c1 - o[c1 - 1 + size*(c2 - 1)];
-			c2 -= o[c1 - 1 + size*(c2 - 1)];
-			c1 = temp;
-			if (c2 >= 1) // still within bounds
-				c1 -= o[bandWidth + size*(c2 - 1)];
-		} else { // left
-			if (count1 == max_count1) {
-				max_count1 *= 2;
-				*indels1 = (int *) realloc(*indels1, max_count1*sizeof(int)); // thread-safe on Windows
-				*lengths1 = (int *) realloc(*lengths1, max_count1*sizeof(int)); // thread-safe on Windows
-				ind1 = indels1[0];
-				len1 = lengths1[0];
-			}
-			ind1[count1] = m1 + 2 - pos1;
-			len1[count1++] = -1*o[c1 - 1 + size*(c2 - 1)];
-			m2 += o[c1 - 1 + size*(c2 - 1)];
-			temp = o[bandWidth + size*(c2 - 1)] + c1;
-			c2 += o[c1 - 1 + size*(c2 - 1)];
-			c1 = temp;
-			if (c2 >= 1) // still within bounds
-				c1 -= o[bandWidth + size*(c2 - 1)];
-		}
-	}
+	tracebackRegion(o, size, slot, anchor, pos1, pos2, l1, l2, M1, M2, C1, C2, results, indels1, lengths1, indels2, lengths2);
 	free(o);
-	if (m1 >= pos1) {
-		if (count2 == max_count2) {
-			max_count2++;
-			*indels2 = (int *) realloc(*indels2, max_count2*sizeof(int)); // thread-safe on Windows
-			*lengths2 = (int *) realloc(*lengths2, max_count2*sizeof(int)); // thread-safe on Windows
-			ind2 = indels2[0];
-			len2 = lengths2[0];
-		}
-		ind2[count2] = 1; // relative to pos2
-		len2[count2++] = m1 - pos1 + 1;
-	}
-	if (m2 >= pos2) {
-		if (count1 == max_count1) {
-			max_count1++;
-			*indels1 = (int *) realloc(*indels1, max_count1*sizeof(int)); // thread-safe on Windows
-			*lengths1 = (int *) realloc(*lengths1, max_count1*sizeof(int)); // thread-safe on Windows
-			ind1 = indels1[0];
-			len1 = lengths1[0];
-		}
-		ind1[count1] = 1; // relative to pos1
-		len1[count1++] = m2 - pos2 + 1;
-	}
-	if (anchor == -1) { // make positions relative to end
-		for (i = 0; i < count1; i++)
-			ind1[i] = end1 - pos1 - ind1[i] + 3;
-		for (i = 0; i < count2; i++)
-			ind2[i] = end2 - pos2 - ind2[i] + 3;
-		pos1 = l1 - end1 + 1;
-		pos2 = l2 - end2 + 1;
-		end1 = l1;
-		end2 = l2;
-	}
-	results[0] = count1;
-	results[1] = count2;
-	results[2] = pos1;
-	results[3] = end1;
-	results[4] = pos2;
-	results[5] = end2;
 	
 	return 0; // signal success
 }
 
-SEXP alignPairs(SEXP pattern, SEXP subject, SEXP query, SEXP target, SEXP position, SEXP bandWidth, SEXP gapOpening, SEXP gapExtension, SEXP dropScore, SEXP subMatrix, SEXP matchMatrix, SEXP letters, SEXP verbose, SEXP pBar, SEXP nThreads)
+// one region of a pair to align between anchors
+typedef struct {
+	Chars_holder s1, s2;
+	int pos1, pos2, l1, l2, anchor;
+	int index1, index2; // pattern and subject numbers
+	int signal; // completion signal (success == 0)
+	int *results, **indels1, **lengths1, **indels2, **lengths2;
+	int pair; // pair number
+	double cells; // number of scored positions
+	int expansions; // number of times the band widened
+} Region;
+
+// align many regions one at a time
+static void alignRegions(Region *r, int n, int bandWidth, int adaptive, double GO, double GE, double dropScore, double *subMatrix, int *lkup_row, int *lkup_col)
 {
 	int i;
-	int *q = INTEGER(query);
-	int *t = INTEGER(target);
-	int l = length(query);
-	int bW = asInteger(bandWidth);
-	double GO = asReal(gapOpening);
-	double GE = asReal(gapExtension);
-	double dS = asReal(dropScore);
-	double *sM = REAL(subMatrix);
-	int *mM = INTEGER(matchMatrix);
-	int nthreads = asInteger(nThreads);
-	
-	int before, v, *rPercentComplete;
-	double complete, soFar;
-	SEXP percentComplete, utilsPackage;
-	v = asLogical(verbose);
-	if (v) { // percent complete variables
-		complete = 0; // completed iterations
-		soFar = 0;
-		before = 0;
-		PROTECT(percentComplete = NEW_INTEGER(1));
-		rPercentComplete = INTEGER(percentComplete);
-		// make it possible to access R functions from the utils package for the progress bar
-		PROTECT(utilsPackage = eval(lang2(install("getNamespace"), ScalarString(mkChar("utils"))), R_GlobalEnv));
-	}
 	
-	// set up a timer to minimize interrupt checks
-	time_t start, end;
-	double elapsed;
-	time(&start);
+	for (i = 0; i < n; i++)
+		r[i].signal = alignRegion(&r[i].s1, &r[i].s2, r[i].pos1, r[i].pos2, r[i].l1, r[i].l2, r[i].anchor, bandWidth, adaptive, GO, GE, dropScore, subMatrix, lkup_row, lkup_col, r[i].results, r[i].indels1, r[i].lengths1, r[i].indels2, r[i].lengths2, &r[i].cells, &r[i].expansions);
+}
+
+// align n pairs between their anchors (4 x N[i] matrices) and score them,
+// returning nonzero with an error code, sequence, and number in err
+int alignAnchoredPairs(int n, const char **p, const int *pl, const char **s, const int *sl, int **anchors, const int *N, const int *index1, const int *index2, int first, int bandWidth, int adaptive, double GO, double GE, double dropScore, double *subMatrix, int *matchMatrix, int *lkup_row, int *lkup_col, PairAlignment *a, int *err)
+{
+	int i, j, k;
 	
-	// build a vector of thread-safe pointers
-	int **ptrs = (int **) malloc(l*sizeof(int *)); // thread-safe on Windows
-	int *tot = (int *) malloc((l + 1)*sizeof(int)); // thread-safe on Windows
+	int *tot = (int *) malloc((n + 1)*sizeof(int)); // thread-safe on Windows
 	tot[0] = 0;
-	for (i = 0; i < l; i++) {
-		ptrs[i] = INTEGER(VECTOR_ELT(position, i)); // anchor matrix
-		tot[i + 1] = tot[i] + length(VECTOR_ELT(position, i))/4 + 1;
-	}
-	
-	XStringSet_holder p_set, s_set, l_set;
-	p_set = hold_XStringSet(pattern);
-	s_set = hold_XStringSet(subject);
-	l_set = hold_XStringSet(letters);
-	Chars_holder l_i = get_elt_from_XStringSet_holder(&l_set, 0);
-	int *lkup_row = (int *) malloc(256*sizeof(int)); // thread-safe on Windows
-	int *lkup_col = (int *) malloc(256*sizeof(int)); // thread-safe on Windows
-	for (i = 0; i < 256; i++) {
-		lkup_row[i] = NA_INTEGER;
-		lkup_col[i] = NA_INTEGER;
-	}
-	for (i = 0; i < l_i.length; i++) {
-		lkup_row[(unsigned char)l_i.ptr[i]] = i;
-		lkup_col[(unsigned char)l_i.ptr[i]] = i*l_i.length;
+	for (i = 0; i < n; i++) {
+		tot[i + 1] = tot[i] + N[i] + 1; // regions between anchors
+		a[i].count1 = 0;
+		a[i].count2 = 0;
+		a[i].indels1 = NULL;
+		a[i].lengths1 = NULL;
+		a[i].indels2 = NULL;
+		a[i].lengths2 = NULL;
+		a[i].cells = 0;
+		a[i].expansions = 0;
 	}
+	int T = tot[n]; // number of regions
 	
-	// built output vectors for alignment results
-	int **res1 = (int **) malloc(tot[l]*sizeof(int *)); // thread-safe on Windows
-	int **res2 = (int **) malloc(tot[l]*sizeof(int *)); // thread-safe on Windows
-	int **res3 = (int **) malloc(tot[l]*sizeof(int *)); // thread-safe on Windows
-	int **res4 = (int **) malloc(tot[l]*sizeof(int *)); // thread-safe on Windows
-	int **res5 = (int **) malloc(tot[l]*sizeof(int *)); // thread-safe on Windows
-	
-	// initialize empty results
-	for (i = 0; i < tot[l]; i++) {
-		int *res = (int *) malloc(6*sizeof(int)); // thread-safe on Windows
-		res[0] = -1; // no memory allocated for indels in pattern
-		res[1] = -1; // no memory allocated for indels in subject
-		res1[i] = res;
+	// results of each region
+	int *results = (int *) malloc(6*T*sizeof(int)); // thread-safe on Windows
+	int **res1 = (int **) malloc(T*sizeof(int *)); // thread-safe on Windows
+	int **res2 = (int **) malloc(T*sizeof(int *)); // thread-safe on Windows
+	int **res3 = (int **) malloc(T*sizeof(int *)); // thread-safe on Windows
+	int **res4 = (int **) malloc(T*sizeof(int *)); // thread-safe on Windows
+	int **res5 = (int **) malloc(T*sizeof(int *)); // thread-safe on Windows
+	Region *r = (Region *) malloc(T*sizeof(Region)); // thread-safe on Windows
+	int *off1 = (int *) malloc(T*sizeof(int)); // thread-safe on Windows
+	int *off2 = (int *) malloc(T*sizeof(int)); // thread-safe on Windows
+	int *aligned = (int *) calloc(n, sizeof(int)); // thread-safe on Windows
+	int R = 0; // number of regions to align
+	for (i = 0; i < T; i++) {
+		res1[i] = results + 6*i;
+		res1[i][0] = -1; // no memory allocated for indels in pattern
+		res1[i][1] = -1; // no memory allocated for indels in subject
+		off1[i] = NA_INTEGER; // no relative positions
+		off2[i] = NA_INTEGER;
 	}
+	err[0] = 0;
 	
-	// initialize output vectors
-	SEXP ans1, ans2, ans3, ans4;
-	PROTECT(ans1 = allocVector(INTSXP, l));
-	int *starts1 = INTEGER(ans1);
-	PROTECT(ans2 = allocVector(INTSXP, l));
-	int *ends1 = INTEGER(ans2);
-	PROTECT(ans3 = allocVector(INTSXP, l));
-	int *starts2 = INTEGER(ans3);
-	PROTECT(ans4 = allocVector(INTSXP, l));
-	int *ends2 = INTEGER(ans4);
-	
-	int abort[3] = {0, 0, 0};
-	#ifdef _OPENMP
-	#pragma omp parallel for private(i) schedule(dynamic) num_threads(nthreads)
-	#endif
-	for (i = 0; i < l; i++) {
-		if (abort[0] == 0) {
-			int index1 = q[i];
-			int index2 = t[i];
-			int *anchor = ptrs[i];
-			Chars_holder p_i = get_elt_from_XStringSet_holder(&p_set, index1 - 1);
-			Chars_holder s_i = get_elt_from_XStringSet_holder(&s_set, index2 - 1);
-			int N = tot[i + 1] - tot[i] - 1; // number of anchors
-			int n = tot[i];
-			int signal; // completion signal (success == 0)
-			int *res, p1, p2, q1, q2, k;
-			if (N == 0) { // no anchor positions
-				starts1[i] = 1;
-				starts2[i] = 1;
-				ends1[i] = p_i.length;
-				ends2[i] = s_i.length;
-				signal = alignRegion(&p_i, &s_i, 1, 1, p_i.length, s_i.length, 0, bW, GO, GE, dS, sM, lkup_row, lkup_col, res1[n], &res2[n], &res3[n], &res4[n], &res5[n]);
-				if (signal != 0) {
-					abort[0] = 1; // unknown character flag
-					abort[1] = signal > 0 ? index1 : index2; // sequence flag
-					abort[2] = signal; // letter number
+	// plan the regions of each pair between its anchors
+	for (i = 0; i < n; i++) {
+		int *anchor = anchors[i];
+		Chars_holder p_i, s_i;
+		p_i.ptr = p[i];
+		p_i.length = pl[i];
+		s_i.ptr = s[i];
+		s_i.length = sl[i];
+		int n_i = tot[i];
+		int *res, p1, p2, q1, q2;
+		if (N[i] == 0) { // no anchor positions
+			a[i].start1 = 1;
+			a[i].start2 = 1;
+			a[i].end1 = p_i.length;
+			a[i].end2 = s_i.length;
+			r[R++] = (Region){p_i, s_i, 1, 1, p_i.length, s_i.length, 0, index1[i], index2[i], 0, res1[n_i], &res2[n_i], &res3[n_i], &res4[n_i], &res5[n_i], i, 0, 0};
+		} else {
+			p1 = anchor[0] - 1; // right bound in pattern
+			p2 = anchor[2] - 1; // right bound in subject
+			if (p1 > 0 && p2 > 0) {
+				if (p1 < 1 || p1 > p_i.length) {
+					err[0] = 3; // out-of-bounds anchors flag
+					err[1] = first + i + 1; // sequence flag
+					err[2] = 1; // anchor number
 					continue;
 				}
-			} else {
-				p1 = anchor[0] - 1; // right bound in pattern
-				p2 = anchor[2] - 1; // right bound in subject
-				if (p1 > 0 && p2 > 0) {
-					if (p1 < 1 || p1 > p_i.length) {
-						abort[0] = 3; // out-of-bounds anchors flag
-						abort[1] = i + 1; // sequence flag
-						abort[2] = 1; // anchor number
-						continue;
-					}
-					if (p2 < 1 || p2 > s_i.length) {
-						abort[0] = 3; // out-of-bounds anchors flag
-						abort[1] = -1 - i; // sequence flag
-						abort[2] = 1; // anchor number
-						continue;
-					}
-					signal = alignRegion(&p_i, &s_i, 1, 1, p1, p2, -1, bW, GO, GE, dS, sM, lkup_row, lkup_col, res1[n], &res2[n], &res3[n], &res4[n], &res5[n]);
-					if (signal != 0) {
-						abort[0] = 1; // unknown character flag
-						abort[1] = signal > 0 ? index1 : index2; // sequence flag
-						abort[2] = signal; // letter number
-						continue;
-					}
-					res = res1[n];
-					starts1[i] = res[2];
-					starts2[i] = res[4];
-				} else if (p1 >= 0 && p2 >= 0) {
-					starts1[i] = anchor[0];
-					starts2[i] = anchor[2];
-				} else { // virtual anchor out of bounds
-					starts1[i] = 1;
-					starts2[i] = 1;
+				if (p2 < 1 || p2 > s_i.length) {
+					err[0] = 3; // out-of-bounds anchors flag
+					err[1] = -1 - first - i; // sequence flag
+					err[2] = 1; // anchor number
+					continue;
 				}
-				n++;
-				for (int j = 1; j < N; j++) {
-					p1 = anchor[1 + 4*(j - 1)];
-					q1 = anchor[4*j];
-					if (p1 > q1) {
-						abort[0] = 2; // overlapping anchor flag
-						abort[1] = i + 1; // anchor flag
-						abort[2] = j; // anchor number
-						continue;
-					}
-					p2 = anchor[3 + 4*(j - 1)];
-					q2 = anchor[2 + 4*j];
-					if (p2 > q2) {
-						abort[0] = 2; // overlapping anchor flag
-						abort[1] = i + 1; // anchor flag
-						abort[2] = -1*j; // anchor number
-						continue;
+				r[R++] = (Region){p_i, s_i, 1, 1, p1, p2, -1, index1[i], index2[i], 0, res1[n_i], &res2[n_i], &res3[n_i], &res4[n_i], &res5[n_i], i, 0, 0};
+				aligned[i] |= 1; // starts from leading region
+			} else if (p1 >= 0 && p2 >= 0) {
+				a[i].start1 = anchor[0];
+				a[i].start2 = anchor[2];
+			} else { // virtual anchor out of bounds
+				a[i].start1 = 1;
+				a[i].start2 = 1;
+			}
+			n_i++;
+			for (j = 1; j < N[i]; j++) {
+				p1 = anchor[1 + 4*(j - 1)];
+				q1 = anchor[4*j];
+				if (p1 > q1) {
+					err[0] = 2; // overlapping anchor flag
+					err[1] = first + i + 1; // anchor flag
+					err[2] = j; // anchor number
+					continue;
+				}
+				p2 = anchor[3 + 4*(j - 1)];
+				q2 = anchor[2 + 4*j];
+				if (p2 > q2) {
+					err[0] = 2; // overlapping anchor flag
+					err[1] = first + i + 1; // anchor flag
+					err[2] = -1*j; // anchor number
+					continue;
+				}
+				p1++;
+				p2++;
+				q1--;
+				q2--;
+				if (q1 < p1) {
+					if (q2 >= p2) {
+						res = res1[n_i];
+						res[0] = 1;
+						res = (int *) malloc(1*sizeof(int)); // thread-safe on Windows
+						res[0] = 1; // relative to p1
+						res2[n_i] = res;
+						res = (int *) malloc(1*sizeof(int)); // thread-safe on Windows
+						res[0] = q2 - p2 + 1;
+						res3[n_i] = res;
+						off1[n_i] = p1;
 					}
-					p1++;
-					p2++;
-					q1--;
-					q2--;
-					if (q1 < p1) {
-						if (q2 >= p2) {
-							res = res1[n];
-							res[0] = 1;
-							res = (int *) malloc(1*sizeof(int)); // thread-safe on Windows
-							res[0] = p1 - starts1[i] + 1;
-							res2[n] = res;
-							res = (int *) malloc(1*sizeof(int)); // thread-safe on Windows
-							res[0] = q2 - p2 + 1;
-							res3[n] = res;
-						}
-					} else if (q2 < p2) {
-						if (q1 >= p1) {
-							res = res1[n];
-							res[1] = 1;
-							res = (int *) malloc(1*sizeof(int)); // thread-safe on Windows
-							res[0] = p2 - starts2[i] + 1;
-							res4[n] = res;
-							res = (int *) malloc(1*sizeof(int)); // thread-safe on Windows
-							res[0] = q1 - p1 + 1;
-							res5[n] = res;
-						}
-					} else {
-						if (p1 < 1 || q1 > p_i.length) {
-							abort[0] = 3; // out-of-bounds anchor flag
-							abort[1] = i + 1; // sequence flag
-							abort[2] = p1 < 1 ? j : j + 1; // anchor number
-							continue;
-						}
-						if (p2 < 1 || q2 > s_i.length) {
-							abort[0] = 3; // out-of-bounds anchor flag
-							abort[1] = -1 - i; // sequence flag
-							abort[2] = p2 < 1 ? j : j + 1; // anchor number
-							continue;
-						}
-						signal = alignRegion(&p_i, &s_i, p1, p2, q1, q2, 2, bW, GO, GE, dS, sM, lkup_row, lkup_col, res1[n], &res2[n], &res3[n], &res4[n], &res5[n]);
-						if (signal != 0) {
-							abort[0] = 1; // unknown character flag
-							abort[1] = signal > 0 ? index1 : index2; // sequence flag
-							abort[2] = signal; // letter number
-							continue;
-						}
-						res = res1[n];
-						k = res[0];
-						res = res2[n];
-						while (k > 0) {
-							k--;
-							res[k] += p1 - starts1[i];
-						}
-						res = res1[n];
-						k = res[1];
-						res = res4[n];
-						while (k > 0) {
-							k--;
-							res[k] += p2 - starts2[i];
-						}
+				} else if (q2 < p2) {
+					if (q1 >= p1) {
+						res = res1[n_i];
+						res[1] = 1;
+						res = (int *) malloc(1*sizeof(int)); // thread-safe on Windows
+						res[0] = 1; // relative to p2
+						res4[n_i] = res;
+						res = (int *) malloc(1*sizeof(int)); // thread-safe on Windows
+						res[0] = q1 - p1 + 1;
+						res5[n_i] = res;
+						off2[n_i] = p2;
 					}
-					n++;
-				}
-				p1 = anchor[1 + 4*(N - 1)] + 1; // left bound in pattern
-				p2 = anchor[3 + 4*(N - 1)] + 1; // left bound in subject
-				q1 = p_i.length;
-				q2 = s_i.length;
-				if (p1 <= q1 && p2 <= q2) {
+				} else {
 					if (p1 < 1 || q1 > p_i.length) {
-						abort[0] = 3; // out-of-bounds anchor flag
-						abort[1] = i + 1; // sequence flag
-						abort[2] = N; // anchor number
+						err[0] = 3; // out-of-bounds anchor flag
+						err[1] = first + i + 1; // sequence flag
+						err[2] = p1 < 1 ? j : j + 1; // anchor number
 						continue;
 					}
 					if (p2 < 1 || q2 > s_i.length) {
-						abort[0] = 3; // out-of-bounds anchor flag
-						abort[1] = -1 - i; // sequence flag
-						abort[2] = N; // anchor number
+						err[0] = 3; // out-of-bounds anchor flag
+						err[1] = -1 - first - i; // sequence flag
+						err[2] = p2 < 1 ? j : j + 1; // anchor number
 						continue;
 					}
-					signal = alignRegion(&p_i, &s_i, p1, p2, q1, q2, 1, bW, GO, GE, dS, sM, lkup_row, lkup_col, res1[n], &res2[n], &res3[n], &res4[n], &res5[n]);
-					if (signal != 0) {
-						abort[0] = 1; // unknown character flag
-						abort[1] = signal > 0 ? index1 : index2; // sequence flag
-						abort[2] = signal; // letter number
-						continue;
-					}
-					res = res1[n];
-					ends1[i] = res[3];
-					ends2[i] = res[5];
-					res = res1[n];
-					k = res[0];
-					res = res2[n];
-					while (k > 0) {
-						k--;
-						res[k] += p1 - starts1[i];
-					}
-					res = res1[n];
-					k = res[1];
-					res = res4[n];
-					while (k > 0) {
-						k--;
-						res[k] += p2 - starts2[i];
-					}
-				} else if (anchor[1 + 4*(N - 1)] <= q1 && anchor[3 + 4*(N - 1)] <= q2)  {
-					ends1[i] = anchor[1 + 4*(N - 1)];
-					ends2[i] = anchor[3 + 4*(N - 1)];
-				} else { // virtual anchor out of bounds
-					ends1[i] = q1;
-					ends2[i] = q2;
+					r[R++] = (Region){p_i, s_i, p1, p2, q1, q2, 2, index1[i], index2[i], 0, res1[n_i], &res2[n_i], &res3[n_i], &res4[n_i], &res5[n_i], i, 0, 0};
+					off1[n_i] = p1;
+					off2[n_i] = p2;
 				}
+				n_i++;
 			}
-			
-			if (v) {
-				#ifdef _OPENMP
-				#pragma omp critical
-				{
-					complete++;
+			p1 = anchor[1 + 4*(N[i] - 1)] + 1; // left bound in pattern
+			p2 = anchor[3 + 4*(N[i] - 1)] + 1; // left bound in subject
+			q1 = p_i.length;
+			q2 = s_i.length;
+			if (p1 <= q1 && p2 <= q2) {
+				if (p1 < 1 || q1 > p_i.length) {
+					err[0] = 3; // out-of-bounds anchor flag
+					err[1] = first + i + 1; // sequence flag
+					err[2] = N[i]; // anchor number
+					continue;
 				}
-				#else
-				complete++;
-				#endif
-			}
-			
-			#ifdef _OPENMP
-			int master = omp_get_thread_num();
-			#else
-			int master = 0;
-			#endif
-			
-			if (master == 0) { // master thread
-				time(&end);
-				elapsed = difftime(end, start);
-				
-				if (elapsed >= 1) { // at least 1 second has elapsed
-					start = end;
-					if (checkInterrupt() != 0)
-						abort[0] = -1;
-					if (abort[0] == 0 && v) {
-						soFar = complete/l;
-						*rPercentComplete = floor(100*soFar);
-						if (*rPercentComplete > before) { // when the percent has changed
-							// tell the progress bar to update in the R console
-							eval(lang4(install("setTxtProgressBar"), pBar, percentComplete, R_NilValue), utilsPackage);
-							before = *rPercentComplete;
-						}
-					}
+				if (p2 < 1 || q2 > s_i.length) {
+					err[0] = 3; // out-of-bounds anchor flag
+					err[1] = -1 - first - i; // sequence flag
+					err[2] = N[i]; // anchor number
+					continue;
 				}
+				r[R++] = (Region){p_i, s_i, p1, p2, q1, q2, 1, index1[i], index2[i], 0, res1[n_i], &res2[n_i], &res3[n_i], &res4[n_i], &res5[n_i], i, 0, 0};
+				aligned[i] |= 2; // ends from trailing region
+				off1[n_i] = p1;
+				off2[n_i] = p2;
+			} else if (anchor[1 + 4*(N[i] - 1)] <= q1 && anchor[3 + 4*(N[i] - 1)] <= q2)  {
+				a[i].end1 = anchor[1 + 4*(N[i] - 1)];
+				a[i].end2 = anchor[3 + 4*(N[i] - 1)];
+			} else { // virtual anchor out of bounds
+				a[i].end1 = q1;
+				a[i].end2 = q2;
 			}
 		}
 	}
-	free(ptrs);
 	
-	if (abort[0] != 0) {
-		// release memory
-		for (i = 0; i < tot[l]; i++) {
-			int *res = res1[i];
-			if (res[0] >= 0) {
-				free(res2[i]);
-				free(res3[i]);
-			}
-			if (res[1] >= 0) {
-				free(res4[i]);
-				free(res5[i]);
-			}
-			free(res);
+	// align the regions of all pairs together
+	if (err[0] == 0)
+		alignRegions(r, R, bandWidth, adaptive, GO, GE, dropScore, subMatrix, lkup_row, lkup_col);
+	for (i = 0; i < R; i++) {
+		a[r[i].pair].cells += r[i].cells;
+		a[r[i].pair].expansions += r[i].expansions;
+		if (r[i].signal != 0) {
+			err[0] = 1; // unknown character flag
+			err[1] = r[i].signal > 0 ? r[i].index1 : r[i].index2; // sequence flag
+			err[2] = r[i].signal; // letter number
 		}
-		free(res1);
-		free(res2);
-		free(res3);
-		free(res4);
-		free(res5);
-		free(tot);
-		if (v) {
-			UNPROTECT(6);
-		} else {
-			UNPROTECT(4);
+	}
+	
+	for (i = 0; i < n && err[0] == 0; i++) {
+		// make positions relative to the start of each pair
+		int *res;
+		if (aligned[i] & 1) {
+			res = res1[tot[i]];
+			a[i].start1 = res[2];
+			a[i].start2 = res[4];
 		}
-		if (abort[0] < 0) {
-			error("Received user interrupt.");
-		} else if (abort[0] == 1) {
-			if (abort[2] > 0) {
-				error("Unexpected character in pattern[%d] position %d.", abort[1], abort[2]);
-			} else {
-				error("Unexpected character in subject[%d] position %d.", abort[1], -1*abort[2]);
-			}
-		} else if (abort[0] == 2) {
-			if (abort[2] > 0) {
-				error("Overlapping pattern anchor in Position[%d] column %d.", abort[1], abort[2]);
-			} else {
-				error("Overlapping subject anchor in Position[%d] column %d.", abort[1], -1*abort[2]);
+		if (aligned[i] & 2) {
+			res = res1[tot[i + 1] - 1];
+			a[i].end1 = res[3];
+			a[i].end2 = res[5];
+		}
+		for (j = tot[i]; j < tot[i + 1]; j++) {
+			if (off1[j] != NA_INTEGER) {
+				res = res2[j];
+				for (k = 0; k < res1[j][0]; k++)
+					res[k] += off1[j] - a[i].start1;
 			}
-		} else if (abort[0] == 3) {
-			if (abort[1] > 0) {
-				error("Out-of-bounds pattern anchor in Position[%d] column %d.", abort[1], abort[2]);
-			} else {
-				error("Out-of-bounds subject anchor in Position[%d] column %d.", -1*abort[1], abort[2]);
+			if (off2[j] != NA_INTEGER) {
+				res = res4[j];
+				for (k = 0; k < res1[j][1]; k++)
+					res[k] += off2[j] - a[i].start2;
 			}
-		} else {
-			error("Unknown error.");
 		}
-	}
-	
-	// initialize output vectors
-	SEXP ans5, ans6, ans7, ans8, ans9, ans10, ans11, ans12;
-	PROTECT(ans5 = allocVector(INTSXP, l));
-	int *matches = INTEGER(ans5);
-	PROTECT(ans6 = allocVector(INTSXP, l));
-	int *mismatches = INTEGER(ans6);
-	PROTECT(ans7 = allocVector(INTSXP, l));
-	int *counts = INTEGER(ans7);
-	PROTECT(ans8 = allocVector(REALSXP, l));
-	double *scores = REAL(ans8);
-	PROTECT(ans9 = allocVector(VECSXP, l));
-	PROTECT(ans10 = allocVector(VECSXP, l));
-	PROTECT(ans11 = allocVector(VECSXP, l));
-	PROTECT(ans12 = allocVector(VECSXP, l));
-	
-	int j, k, p, p1, p2, c1, c2, ms, mms, count, count1, count2;
-	int *res, *ind1, *len1, *ind2, *len2;
-	double score;
-	SEXP indels1, lengths1, indels2, lengths2;
-	unsigned char s1, s2; // sequence positions
-	for (i = 0; i < l; i++) {
-		count1 = 0;
-		count2 = 0;
+		
+		// concatenate indels across regions
+		int count1 = 0;
+		int count2 = 0;
 		for (j = tot[i]; j < tot[i + 1]; j++) {
 			res = res1[j];
 			if (res[0] > 0)
@@ -1413,84 +1402,56 @@ SEXP alignPairs(SEXP pattern, SEXP subject, SEXP query, SEXP target, SEXP positi
 			if (res[1] > 0)
 				count2 += res[1];
 		}
-		PROTECT(indels1 = allocVector(INTSXP, count1));
-		ind1 = INTEGER(indels1);
-		PROTECT(lengths1 = allocVector(INTSXP, count1));
-		len1 = INTEGER(lengths1);
-		PROTECT(indels2 = allocVector(INTSXP, count2));
-		ind2 = INTEGER(indels2);
-		PROTECT(lengths2 = allocVector(INTSXP, count2));
-		len2 = INTEGER(lengths2);
+		int *ind1 = (int *) malloc(count1*sizeof(int)); // thread-safe on Windows
+		int *len1 = (int *) malloc(count1*sizeof(int)); // thread-safe on Windows
+		int *ind2 = (int *) malloc(count2*sizeof(int)); // thread-safe on Windows
+		int *len2 = (int *) malloc(count2*sizeof(int)); // thread-safe on Windows
 		count1 = 0;
 		count2 = 0;
-		int N = tot[i + 1] - tot[i] - 1; // number of anchors
 		for (j = tot[i]; j < tot[i + 1]; j++) {
 			res = res1[j];
-			p = res[0];
-			if (j == tot[i] && N > 0) { // record forwards
-				for (k = 0; k < p; k++) {
-					res = res2[j];
-					ind1[count1] = res[k];
-					res = res3[j];
-					len1[count1++] = res[k];
+			if (j == tot[i] && N[i] > 0) { // record forwards
+				for (k = 0; k < res[0]; k++) {
+					ind1[count1] = res2[j][k];
+					len1[count1++] = res3[j][k];
 				}
-			} else { // record backwards
-				for (k = p - 1; k >= 0; k--) {
-					res = res2[j];
-					ind1[count1] = res[k];
-					res = res3[j];
-					len1[count1++] = res[k];
-				}
-			}
-			if (p >= 0) {
-				res = res2[j];
-				free(res);
-				res = res3[j];
-				free(res);
-			}
-			res = res1[j];
-			p = res[1];
-			if (j == tot[i] && N > 0) { // record forwards
-				for (k = 0; k < p; k++) {
-					res = res4[j];
-					ind2[count2] = res[k];
-					res = res5[j];
-					len2[count2++] = res[k];
+				for (k = 0; k < res[1]; k++) {
+					ind2[count2] = res4[j][k];
+					len2[count2++] = res5[j][k];
 				}
 			} else { // record backwards
-				for (k = p - 1; k >= 0; k--) {
-					res = res4[j];
-					ind2[count2] = res[k];
-					res = res5[j];
-					len2[count2++] = res[k];
+				for (k = res[0] - 1; k >= 0; k--) {
+					ind1[count1] = res2[j][k];
+					len1[count1++] = res3[j][k];
+				}
+				for (k = res[1] - 1; k >= 0; k--) {
+					ind2[count2] = res4[j][k];
+					len2[count2++] = res5[j][k];
 				}
 			}
-			if (p >= 0) {
-				res = res4[j];
-				free(res);
-				res = res5[j];
-				free(res);
-			}
-			res = res1[j];
-			free(res);
 		}
+		a[i].count1 = count1;
+		a[i].count2 = count2;
+		a[i].indels1 = ind1;
+		a[i].lengths1 = len1;
+		a[i].indels2 = ind2;
+		a[i].lengths2 = len2;
 		
 		// calculate matches, mismatches, score, and alignment length
-		Chars_holder p_i = get_elt_from_XStringSet_holder(&p_set, q[i] - 1);
-		Chars_holder s_i = get_elt_from_XStringSet_holder(&s_set, t[i] - 1);
-		p1 = 1; // position in pattern
-		p2 = 1; // position in subject
-		c1 = 0; // position in indels1
-		c2 = 0; // position in indels2
-		count = 0; // alignment length
-		score = 0; // alignment score
-		mms = 0; // number of mismatches
-		ms = 0; // number of matches
-		while (p1 + starts1[i] - 1 <= ends1[i] ||
-			p2 + starts2[i] - 1 <= ends2[i]) {
+		int p1 = 1; // position in pattern
+		int p2 = 1; // position in subject
+		int c1 = 0; // position in indels1
+		int c2 = 0; // position in indels2
+		int count = 0; // alignment length
+		double score = 0; // alignment score
+		int mms = 0; // number of mismatches
+		int ms = 0; // number of matches
+		unsigned char s1, s2; // sequence positions
+		while (p1 + a[i].start1 - 1 <= a[i].end1 ||
+			p2 + a[i].start2 - 1 <= a[i].end2) {
 			if (c1 < count1 && p1 == ind1[c1]) {
-				if (N > 0 || // anchored alignment
-					(p1 > 1 && p2 > 1 && p1 <= ends1[i] && p2 <= ends2[i])) { // internal gap
+				if (N[i] > 0 || // anchored alignment
+					(p1 > 1 && p2 > 1 && p1 <= a[i].end1 && p2 <= a[i].end2)) { // internal gap
 					count += len1[c1]; // add gap to count
 					score += GO;
 					if (len1[c1] > 1)
@@ -1499,8 +1460,8 @@ SEXP alignPairs(SEXP pattern, SEXP subject, SEXP query, SEXP target, SEXP positi
 				p2 += len1[c1]; // skip subject positions
 				c1++; // advance to next gap in pattern
 			} else if (c2 < count2 && p2 == ind2[c2]) {
-				if (N > 0 || // anchored alignment
-					(p1 > 1 && p2 > 1 && p1 <= ends1[i] && p2 <= ends2[i])) { // internal gap
+				if (N[i] > 0 || // anchored alignment
+					(p1 > 1 && p2 > 1 && p1 <= a[i].end1 && p2 <= a[i].end2)) { // internal gap
 					count += len2[c2]; // add gap to count
 					score += GO;
 					if (len2[c2] > 1)
@@ -1510,52 +1471,273 @@ SEXP alignPairs(SEXP pattern, SEXP subject, SEXP query, SEXP target, SEXP positi
 				c2++; // advance to next gap in subject
 			} else {
 				count++; // increment count
-				s1 = (unsigned char)p_i.ptr[p1 + starts1[i] - 2];
-				s2 = (unsigned char)s_i.ptr[p2 + starts2[i] - 2];
+				s1 = (unsigned char)p[i][p1 + a[i].start1 - 2];
+				s2 = (unsigned char)s[i][p2 + a[i].start2 - 2];
 				if (lkup_row[s1] == NA_INTEGER) {
-					abort[0] = 1;
-					abort[1] = q[i];
-					abort[2] = p1 + starts1[i] - 1;
+					err[0] = 1;
+					err[1] = index1[i];
+					err[2] = p1 + a[i].start1 - 1;
 					break;
 				}
 				if (lkup_col[s2] == NA_INTEGER) {
-					abort[0] = 1;
-					abort[1] = t[i];
-					abort[2] = 1 - p2 - starts2[i];
+					err[0] = 1;
+					err[1] = index2[i];
+					err[2] = 1 - p2 - a[i].start2;
 					break;
 				}
-				if (mM[lkup_row[s1] + lkup_col[s2]]) {
+				if (matchMatrix[lkup_row[s1] + lkup_col[s2]]) {
 					ms++;
 				} else {
 					mms++;
 				}
-				score += sM[lkup_row[s1] + lkup_col[s2]];
+				score += subMatrix[lkup_row[s1] + lkup_col[s2]];
 				p1++;
 				p2++;
 			}
 		}
-		mismatches[i] = mms;
-		matches[i] = ms;
-		counts[i] = count;
-		scores[i] = score;
-		
-		SET_VECTOR_ELT(ans9, i, indels1);
-		SET_VECTOR_ELT(ans10, i, lengths1);
-		SET_VECTOR_ELT(ans11, i, indels2);
-		SET_VECTOR_ELT(ans12, i, lengths2);
-		UNPROTECT(4);
+		a[i].mismatches = mms;
+		a[i].matches = ms;
+		a[i].length = count;
+		a[i].score = score;
 	}
+	
+	// release memory
+	for (i = 0; i < T; i++) {
+		if (res1[i][0] >= 0) {
+			free(res2[i]);
+			free(res3[i]);
+		}
+		if (res1[i][1] >= 0) {
+			free(res4[i]);
+			free(res5[i]);
+		}
+	}
+	free(results);
 	free(res1);
 	free(res2);
 	free(res3);
 	free(res4);
 	free(res5);
+	free(r);
+	free(off1);
+	free(off2);
+	free(aligned);
 	free(tot);
+	
+	return err[0];
+}
+
+SEXP alignPairs(SEXP pattern, SEXP subject, SEXP query, SEXP target, SEXP position, SEXP bandWidth, SEXP adaptiveBand, SEXP gapOpening, SEXP gapExtension, SEXP dropScore, SEXP subMatrix, SEXP matchMatrix, SEXP letters, SEXP verbose, SEXP pBar, SEXP nThreads)
+{
+	int i;
+	StageTimer timer = startStage();
+	int *q = INTEGER(query);
+	int *t = INTEGER(target);
+	int l = length(query);
+	int bW = asInteger(bandWidth);
+	int aB = asLogical(adaptiveBand);
+	double GO = asReal(gapOpening);
+	double GE = asReal(gapExtension);
+	double dS = asReal(dropScore);
+	double *sM = REAL(subMatrix);
+	int *mM = INTEGER(matchMatrix);
+	int nthreads = asInteger(nThreads);
+	
+	int v = asLogical(verbose);
+	
+	// worker threads count completed pairs for the master thread to report
+	Progress prog;
+	initProgress(&prog, l, v, pBar);
+	
+	XStringSet_holder p_set, s_set, l_set;
+	p_set = hold_XStringSet(pattern);
+	s_set = hold_XStringSet(subject);
+	l_set = hold_XStringSet(letters);
+	Chars_holder l_i = get_elt_from_XStringSet_holder(&l_set, 0);
+	int *lkup_row = (int *) malloc(256*sizeof(int)); // thread-safe on Windows
+	int *lkup_col = (int *) malloc(256*sizeof(int)); // thread-safe on Windows
+	for (i = 0; i < 256; i++) {
+		lkup_row[i] = NA_INTEGER;
+		lkup_col[i] = NA_INTEGER;
+	}
+	for (i = 0; i < l_i.length; i++) {
+		lkup_row[(unsigned char)l_i.ptr[i]] = i;
+		lkup_col[(unsigned char)l_i.ptr[i]] = i*l_i.length;
+	}
+	
+	// build vectors of thread-safe pointers
+	const char **p = (const char **) malloc(l*sizeof(char *)); // thread-safe on Windows
+	int *pl = (int *) malloc(l*sizeof(int)); // thread-safe on Windows
+	const char **s = (const char **) malloc(l*sizeof(char *)); // thread-safe on Windows
+	int *sl = (int *) malloc(l*sizeof(int)); // thread-safe on Windows
+	int **ptrs = (int **) malloc(l*sizeof(int *)); // thread-safe on Windows
+	int *N = (int *) malloc(l*sizeof(int)); // thread-safe on Windows
+	for (i = 0; i < l; i++) {
+		Chars_holder p_i = get_elt_from_XStringSet_holder(&p_set, q[i] - 1);
+		Chars_holder s_i = get_elt_from_XStringSet_holder(&s_set, t[i] - 1);
+		p[i] = p_i.ptr;
+		pl[i] = p_i.length;
+		s[i] = s_i.ptr;
+		sl[i] = s_i.length;
+		ptrs[i] = INTEGER(VECTOR_ELT(position, i)); // anchor matrix
+		N[i] = length(VECTOR_ELT(position, i))/4; // number of anchors
+	}
+	
+	// alignment results
+	PairAlignment *a = (PairAlignment *) malloc(l*sizeof(PairAlignment)); // thread-safe on Windows
+	
+	int abort[3] = {0, 0, 0};
+	
+	#ifdef _OPENMP
+	#pragma omp parallel for private(i) schedule(dynamic) num_threads(nthreads)
+	#endif
+	for (i = 0; i < l; i++) {
+		if (abort[0] == 0) {
+			int err[3];
+			if (alignAnchoredPairs(1, p + i, pl + i, s + i, sl + i, ptrs + i, N + i, q + i, t + i, i, bW, aB, GO, GE, dS, sM, mM, lkup_row, lkup_col, a + i, err)) {
+				abort[0] = err[0];
+				abort[1] = err[1];
+				abort[2] = err[2];
+			}
+			
+			addProgress(&prog, 1);
+			if (pollProgress(&prog)) // master thread calls back to R
+				abort[0] = -1;
+		} else {
+			a[i].indels1 = NULL;
+			a[i].lengths1 = NULL;
+			a[i].indels2 = NULL;
+			a[i].lengths2 = NULL;
+		}
+	}
+	free(p);
+	free(pl);
+	free(s);
+	free(sl);
+	free(ptrs);
+	free(N);
 	free(lkup_row);
 	free(lkup_col);
+	if (finishProgress(&prog) && abort[0] == 0)
+		abort[0] = -1;
+	
+	if (abort[0] != 0) {
+		// release memory
+		for (i = 0; i < l; i++) {
+			free(a[i].indels1);
+			free(a[i].lengths1);
+			free(a[i].indels2);
+			free(a[i].lengths2);
+		}
+		free(a);
+		if (abort[0] < 0) {
+			error("Received user interrupt.");
+		} else if (abort[0] == 1) {
+			if (abort[2] > 0) {
+				error("Unexpected character in pattern[%d] position %d.", abort[1], abort[2]);
+			} else {
+				error("Unexpected character in subject[%d] position %d.", abort[1], -1*abort[2]);
+			}
+		} else if (abort[0] == 2) {
+			if (abort[2] > 0) {
+				error("Overlapping pattern anchor in Position[%d] column %d.", abort[1], abort[2]);
+			} else {
+				error("Overlapping subject anchor in Position[%d] column %d.", abort[1], -1*abort[2]);
+			}
+		} else if (abort[0] == 3) {
+			if (abort[1] > 0) {
+				error("Out-of-bounds pattern anchor in Position[%d] column %d.", abort[1], abort[2]);
+			} else {
+				error("Out-of-bounds subject anchor in Position[%d] column %d.", -1*abort[1], abort[2]);
+			}
+		} else {
+			error("Unknown error.");
+		}
+	}
 	
 	SEXP ret_list;
-	PROTECT(ret_list = allocVector(VECSXP, 12));
+	PROTECT(ret_list = pairAlignmentsAsList(a, l));
+	
+	for (i = 0; i < l; i++) {
+		free(a[i].indels1);
+		free(a[i].lengths1);
+		free(a[i].indels2);
+		free(a[i].lengths2);
+	}
+	free(a);
+	
+	UNPROTECT(1);
+	
+	stopStage(STAGE_ALIGN_PAIRS, timer);
+	
+	return ret_list;
+}
+
+// convert alignment results into the list returned by alignPairs
+SEXP pairAlignmentsAsList(PairAlignment *a, int l)
+{
+	int i, j;
+	
+	SEXP ans1, ans2, ans3, ans4, ans5, ans6, ans7, ans8, ans9, ans10, ans11, ans12, ans13, ans14;
+	PROTECT(ans1 = allocVector(INTSXP, l));
+	int *starts1 = INTEGER(ans1);
+	PROTECT(ans2 = allocVector(INTSXP, l));
+	int *ends1 = INTEGER(ans2);
+	PROTECT(ans3 = allocVector(INTSXP, l));
+	int *starts2 = INTEGER(ans3);
+	PROTECT(ans4 = allocVector(INTSXP, l));
+	int *ends2 = INTEGER(ans4);
+	PROTECT(ans5 = allocVector(INTSXP, l));
+	int *matches = INTEGER(ans5);
+	PROTECT(ans6 = allocVector(INTSXP, l));
+	int *mismatches = INTEGER(ans6);
+	PROTECT(ans7 = allocVector(INTSXP, l));
+	int *counts = INTEGER(ans7);
+	PROTECT(ans8 = allocVector(REALSXP, l));
+	double *scores = REAL(ans8);
+	PROTECT(ans9 = allocVector(VECSXP, l));
+	PROTECT(ans10 = allocVector(VECSXP, l));
+	PROTECT(ans11 = allocVector(VECSXP, l));
+	PROTECT(ans12 = allocVector(VECSXP, l));
+	PROTECT(ans13 = allocVector(REALSXP, l));
+	double *cells = REAL(ans13);
+	PROTECT(ans14 = allocVector(INTSXP, l));
+	int *expansions = INTEGER(ans14);
+	
+	SEXP indels1, lengths1, indels2, lengths2;
+	for (i = 0; i < l; i++) {
+		starts1[i] = a[i].start1;
+		ends1[i] = a[i].end1;
+		starts2[i] = a[i].start2;
+		ends2[i] = a[i].end2;
+		matches[i] = a[i].matches;
+		mismatches[i] = a[i].mismatches;
+		counts[i] = a[i].length;
+		scores[i] = a[i].score;
+		cells[i] = a[i].cells;
+		expansions[i] = a[i].expansions;
+		
+		PROTECT(indels1 = allocVector(INTSXP, a[i].count1));
+		PROTECT(lengths1 = allocVector(INTSXP, a[i].count1));
+		for (j = 0; j < a[i].count1; j++) {
+			INTEGER(indels1)[j] = a[i].indels1[j];
+			INTEGER(lengths1)[j] = a[i].lengths1[j];
+		}
+		PROTECT(indels2 = allocVector(INTSXP, a[i].count2));
+		PROTECT(lengths2 = allocVector(INTSXP, a[i].count2));
+		for (j = 0; j < a[i].count2; j++) {
+			INTEGER(indels2)[j] = a[i].indels2[j];
+			INTEGER(lengths2)[j] = a[i].lengths2[j];
+		}
+		SET_VECTOR_ELT(ans9, i, indels1);
+		SET_VECTOR_ELT(ans10, i, lengths1);
+		SET_VECTOR_ELT(ans11, i, indels2);
+		SET_VECTOR_ELT(ans12, i, lengths2);
+		UNPROTECT(4);
+	}
+	
+	SEXP ret_list;
+	PROTECT(ret_list = allocVector(VECSXP, 14));
 	SET_VECTOR_ELT(ret_list, 0, ans1);
 	SET_VECTOR_ELT(ret_list, 1, ans2);
 	SET_VECTOR_ELT(ret_list, 2, ans3);
@@ -1568,18 +1750,10 @@ SEXP alignPairs(SEXP pattern, SEXP subject, SEXP query, SEXP target, SEXP positi
 	SET_VECTOR_ELT(ret_list, 9, ans10);
 	SET_VECTOR_ELT(ret_list, 10, ans11);
 	SET_VECTOR_ELT(ret_list, 11, ans12);
+	SET_VECTOR_ELT(ret_list, 12, ans13);
+	SET_VECTOR_ELT(ret_list, 13, ans14);
 	
-	UNPROTECT(13);
-	if (v)
-		UNPROTECT(2);
-	
-	if (abort[0] != 0) {
-		if (abort[2] > 0) {
-			error("Unexpected character in pattern[%d] position %d.", abort[1], abort[2]);
-		} else {
-			error("Unexpected character in subject[%d] position %d.", abort[1], -1*abort[2]);
-		}
-	}
+	UNPROTECT(15);
 	
 	return ret_list;
 }
@@ -154,19 +154,11 @@ SEXP predictDBN(SEXP x, SEXP output, SEXP minOccupancy, SEXP impact, SEXP avgPro
 	double *w = REAL(weights);
 	int pseudo = asInteger(pseudoknots);
 	double thresh = asReal(threshold);
-	int before, v, last, *rPercentComplete;
-	double *rans, soFar;
+	int v;
+	double *rans;
 	int nthreads = asInteger(nThreads);
-	SEXP ans, ans_s, percentComplete, utilsPackage;
+	SEXP ans, ans_s;
 	v = asLogical(verbose);
-	if (v) { // percent complete variables
-		soFar = 0;
-		before = 0;
-		PROTECT(percentComplete = NEW_INTEGER(1));
-		rPercentComplete = INTEGER(percentComplete);
-		// make it possible to access R functions from the utils package for the progress bar
-		PROTECT(utilsPackage = eval(lang2(install("getNamespace"), ScalarString(mkChar("utils"))), R_GlobalEnv));
-	}
 	
 	XStringSet_holder x_set;
 	x_set = hold_XStringSet(x);
@@ -236,139 +228,153 @@ SEXP predictDBN(SEXP x, SEXP output, SEXP minOccupancy, SEXP impact, SEXP avgPro
 	double *MI = Calloc(tot*tot, double); // initialized to zero
 	double *rowMeans = Calloc(tot, double); // initialized to zero
 	
-	last = tot - 1;
-	for (i = 0; i < (tot - 1); i++) {
-		#ifdef _OPENMP
-		#pragma omp parallel for private(j,l,s,x_s) schedule(guided) num_threads(nthreads)
-		#endif
-		for (j = i + 1; j < tot; j++) {
-			double AU = 0, UA = 0, GC = 0, CG = 0, GU = 0, UG = 0, other = 0, temp = 0, bg;
-			l = 0;
+	// one parallel region avoids a fork and join per row
+	Progress prog;
+	initProgress(&prog, (double)tot*(tot - 1)/2, v, pBar);
+	#ifdef _OPENMP
+	#pragma omp parallel private(i,j,l,s,x_s) num_threads(nthreads)
+	#endif
+	{
+		for (i = 0; i < (tot - 1); i++) {
+			double done = 0; // pairs completed by this thread
 			
-			for (s = 0; s < x_length; s++) {
-				if (pos[i] < endpoints[s] || pos[j] > endpoints[x_length + s])
+			#ifdef _OPENMP
+			#pragma omp for schedule(guided) nowait
+			#endif
+			for (j = i + 1; j < tot; j++) {
+				if (progressInterrupted(&prog))
 					continue;
+				done++;
 				
-				x_s = get_elt_from_XStringSet_holder(&x_set, s);
-				
-				int p1, p2;
-				switch (x_s.ptr[pos[i]]) {
-					case 1: // A
-						p1 = 1;
-						break;
-					case 2: // C
-						p1 = 2;
-						break;
-					case 4: // G
-						p1 = 3;
-						break;
-					case 8: // T/U
-						p1 = 4;
-						break;
-					default: // other
-						p1 = 5;
-						break;
-				}
-				switch (x_s.ptr[pos[j]]) {
-					case 1: // A
-						p2 = 1;
-						break;
-					case 2: // C
-						p2 = 2;
-						break;
-					case 4: // G
-						p2 = 3;
-						break;
-					case 8: // T/U
-						p2 = 4;
-						break;
-					default: // other
-						p2 = 5;
-						break;
-				}
+				double AU = 0, UA = 0, GC = 0, CG = 0, GU = 0, UG = 0, other = 0, temp = 0, bg;
+				l = 0;
 				
-				if (p1 == 5) { // -
-					other += w[s];
-				} else if (p2 == 5) { // -
-					other += w[s];
-				} else if (p1 == 1) { // A
-					if (p2 == 4) { // T/U
-						AU += w[s];
-					} else {
-						other += w[s];
+				for (s = 0; s < x_length; s++) {
+					if (pos[i] < endpoints[s] || pos[j] > endpoints[x_length + s])
+						continue;
+					
+					x_s = get_elt_from_XStringSet_holder(&x_set, s);
+					
+					int p1, p2;
+					switch (x_s.ptr[pos[i]]) {
+						case 1: // A
+							p1 = 1;
+							break;
+						case 2: // C
+							p1 = 2;
+							break;
+						case 4: // G
+							p1 = 3;
+							break;
+						case 8: // T/U
+							p1 = 4;
+							break;
+						default: // other
+							p1 = 5;
+							break;
 					}
-				} else if (p1 == 2) { // C
-					if (p2 == 3) { // G
-						CG += w[s];
-					} else {
-						other += w[s];
+					switch (x_s.ptr[pos[j]]) {
+						case 1: // A
+							p2 = 1;
+							break;
+						case 2: // C
+							p2 = 2;
+							break;
+						case 4: // G
+							p2 = 3;
+							break;
+						case 8: // T/U
+							p2 = 4;
+							break;
+						default: // other
+							p2 = 5;
+							break;
 					}
-				} else if (p1 == 3) { // G
-					if (p2 == 2) { // C
-						GC += w[s];
-					} else if (p2 == 4) { // T/U
-						GU += w[s];
-					} else {
+					
+					if (p1 == 5) { // -
 						other += w[s];
-					}
-				} else if (p1 == 4) { // T/U
-					if (p2 == 1) { // A
-						UA += w[s];
-					} else if (p2 == 3) { // G
-						UG += w[s];
-					} else {
+					} else if (p2 == 5) { // -
 						other += w[s];
+					} else if (p1 == 1) { // A
+						if (p2 == 4) { // T/U
+							AU += w[s];
+						} else {
+							other += w[s];
+						}
+					} else if (p1 == 2) { // C
+						if (p2 == 3) { // G
+							CG += w[s];
+						} else {
+							other += w[s];
+						}
+					} else if (p1 == 3) { // G
+						if (p2 == 2) { // C
+							GC += w[s];
+						} else if (p2 == 4) { // T/U
+							GU += w[s];
+						} else {
+							other += w[s];
+						}
+					} else if (p1 == 4) { // T/U
+						if (p2 == 1) { // A
+							UA += w[s];
+						} else if (p2 == 3) { // G
+							UG += w[s];
+						} else {
+							other += w[s];
+						}
 					}
 				}
+				
+				// normalize to x_length
+				AU /= x_length;
+				UA /= x_length;
+				GC /= x_length;
+				CG /= x_length;
+				GU /= x_length;
+				UG /= x_length;
+				other /= x_length; // other does not include terminal gaps
+				
+				bg = counts[5*pos[i]]*counts[5*pos[j] + 3]; // AU
+				if (bg > 0 && AU > 0)
+					temp += AU*log2(AU/bg)*coef[0];
+				bg = counts[5*pos[i] + 3]*counts[5*pos[j]]; // UA
+				if (bg > 0 && UA > 0)
+					temp += UA*log2(UA/bg)*coef[0];
+				bg = counts[5*pos[i] + 2]*counts[5*pos[j] + 1]; // GC
+				if (bg > 0 && GC > 0)
+					temp += GC*log2(GC/bg)*coef[1];
+				bg = counts[5*pos[i] + 1]*counts[5*pos[j] + 2]; // CG
+				if (bg > 0 && CG > 0)
+					temp += CG*log2(CG/bg)*coef[1];
+				bg = counts[5*pos[i] + 2]*counts[5*pos[j] + 3]; // GU
+				if (bg > 0 && GU > 0)
+					temp += GU*log2(GU/bg)*coef[2];
+				bg = counts[5*pos[i] + 3]*counts[5*pos[j] + 2]; // UG
+				if (bg > 0 && UG > 0)
+					temp += UG*log2(UG/bg)*coef[2];
+				
+				temp += other*coef[3];
+				MI[i*tot + j] = temp;
+				//Rprintf("\ni = %d j = %d MI = %1.2f", pos[i] + 1, pos[j] + 1, MI[i*tot + j]);
 			}
-			
-			// normalize to x_length
-			AU /= x_length;
-			UA /= x_length;
-			GC /= x_length;
-			CG /= x_length;
-			GU /= x_length;
-			UG /= x_length;
-			other /= x_length; // other does not include terminal gaps
-			
-			bg = counts[5*pos[i]]*counts[5*pos[j] + 3]; // AU
-			if (bg > 0 && AU > 0)
-				temp += AU*log2(AU/bg)*coef[0];
-			bg = counts[5*pos[i] + 3]*counts[5*pos[j]]; // UA
-			if (bg > 0 && UA > 0)
-				temp += UA*log2(UA/bg)*coef[0];
-			bg = counts[5*pos[i] + 2]*counts[5*pos[j] + 1]; // GC
-			if (bg > 0 && GC > 0)
-				temp += GC*log2(GC/bg)*coef[1];
-			bg = counts[5*pos[i] + 1]*counts[5*pos[j] + 2]; // CG
-			if (bg > 0 && CG > 0)
-				temp += CG*log2(CG/bg)*coef[1];
-			bg = counts[5*pos[i] + 2]*counts[5*pos[j] + 3]; // GU
-			if (bg > 0 && GU > 0)
-				temp += GU*log2(GU/bg)*coef[2];
-			bg = counts[5*pos[i] + 3]*counts[5*pos[j] + 2]; // UG
-			if (bg > 0 && UG > 0)
-				temp += UG*log2(UG/bg)*coef[2];
-			
-			temp += other*coef[3];
-			MI[i*tot + j] = temp;
-			//Rprintf("\ni = %d j = %d MI = %1.2f", pos[i] + 1, pos[j] + 1, MI[i*tot + j]);
-			
-			rowMeans[j] += temp;
+			addProgress(&prog, done);
+			pollProgress(&prog); // master thread calls back to R
 		}
-		for (j = i + 1; j < tot; j++)
+	}
+	if (finishProgress(&prog)) {
+		Free(MI);
+		Free(rowMeans);
+		Free(endpoints);
+		Free(counts);
+		Free(pos);
+		error("Received user interrupt.");
+	}
+	
+	for (i = 0; i < (tot - 1); i++) {
+		for (j = i + 1; j < tot; j++) {
 			rowMeans[i] += MI[i*tot + j];
-		
-		if (v) { // print the percent completed so far
-			soFar = (2*last - i)*(i + 1);
-			*rPercentComplete = floor(100*soFar/(last*(last + 1)));
-			if (*rPercentComplete > before) { // when the percent has changed
-				// tell the progress bar to update in the R console
-				eval(lang4(install("setTxtProgressBar"), pBar, percentComplete, R_NilValue), utilsPackage);
-				before = *rPercentComplete;
-			}
-		} else {
-			R_CheckUserInterrupt();
+			rowMeans[j] += MI[i*tot + j];
 		}
 	}
 	Free(endpoints);
@@ -1071,11 +1077,7 @@ SEXP predictDBN(SEXP x, SEXP output, SEXP minOccupancy, SEXP impact, SEXP avgPro
 	Free(MI);
 	Free(pos);
 	
-	if (v) {
-		UNPROTECT(3);
-	} else {
-		UNPROTECT(1);
-	}
+	UNPROTECT(1);
 	
 	return ans;
 }
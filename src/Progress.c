@@ -0,0 +1,157 @@
+/****************************************************************************
+ *              Reports Progress and Interrupts from Many Threads           *
+ *                           Author: Erik Wright                            *
+ ****************************************************************************/
+
+// for OpenMP parallel processing
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Rdefines.h is needed for the SEXP typedef, for the error(), INTEGER(),
+ * GET_DIM(), LOGICAL(), NEW_INTEGER(), PROTECT() and UNPROTECT() macros,
+ * and for the NA_INTEGER constant symbol.
+ */
+#include <Rdefines.h>
+
+/*
+ * R_ext/Rdynload.h is needed for the R_CallMethodDef typedef and the
+ * R_registerRoutines() prototype.
+ */
+#include <R_ext/Rdynload.h>
+
+/* for R_CheckUserInterrupt */
+#include <R_ext/Utils.h>
+
+// for floor
+#include <math.h>
+
+// for gettimeofday
+#include <sys/time.h>
+
+// DECIPHER header file
+#include "DECIPHER.h"
+
+#define PROGRESS_INTERVAL 0.5 // seconds between polls
+
+static double wallClock()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec/1e6;
+}
+
+static void updateBar(void *ptr)
+{
+	Progress *p = (Progress *)ptr;
+	eval(lang4(install("setTxtProgressBar"), p->pBar, p->percentComplete, R_NilValue), p->utilsPackage);
+}
+
+// must be called from the master thread before any workers start
+void initProgress(Progress *p, double total, int verbose, SEXP pBar)
+{
+	p->total = total;
+	p->done = 0;
+	p->before = 0;
+	p->interrupted = 0;
+	p->verbose = verbose;
+	p->last = wallClock();
+	p->pBar = pBar;
+	if (verbose) {
+		p->percentComplete = NEW_INTEGER(1);
+		R_PreserveObject(p->percentComplete);
+		// make it possible to access R functions from the utils package for the progress bar
+		p->utilsPackage = eval(lang2(install("getNamespace"), ScalarString(mkChar("utils"))), R_GlobalEnv);
+		R_PreserveObject(p->utilsPackage);
+	}
+}
+
+// called by any thread after completing n units of work
+void addProgress(Progress *p, double n)
+{
+	#ifdef _OPENMP
+	#pragma omp atomic
+	#endif
+	p->done += n;
+}
+
+// called by any thread to decide whether to skip remaining work
+int progressInterrupted(Progress *p)
+{
+	int interrupted;
+	#ifdef _OPENMP
+	#pragma omp atomic read
+	#endif
+	interrupted = p->interrupted;
+	return interrupted;
+}
+
+static int poll(Progress *p)
+{
+	int interrupted = 0;
+	if (checkInterrupt() != 0)
+		interrupted = 1;
+	
+	if (!interrupted && p->verbose) {
+		double done;
+		#ifdef _OPENMP
+		#pragma omp atomic read
+		#endif
+		done = p->done;
+		int percent = (p->total > 0) ? floor(100*done/p->total) : 100;
+		if (percent > 100)
+			percent = 100;
+		if (percent > p->before) { // when the percent has changed
+			// tell the progress bar to update in the R console
+			*INTEGER(p->percentComplete) = percent;
+			if (R_ToplevelExec(updateBar, p) == FALSE)
+				interrupted = 1;
+			p->before = percent;
+		}
+	}
+	
+	if (interrupted) {
+		#ifdef _OPENMP
+		#pragma omp atomic write
+		#endif
+		p->interrupted = 1;
+	}
+	
+	return interrupted;
+}
+
+// called by any thread but only the master thread calls back to R
+// at most once per interval, returning nonzero after an interrupt
+int pollProgress(Progress *p)
+{
+	#ifdef _OPENMP
+	if (omp_get_thread_num() != 0)
+		return progressInterrupted(p);
+	#endif
+	
+	if (p->interrupted)
+		return 1;
+	
+	double now = wallClock();
+	if (now - p->last < PROGRESS_INTERVAL)
+		return 0;
+	p->last = now;
+	
+	return poll(p);
+}
+
+// must be called from the master thread after all workers finish
+// and returns nonzero if the user interrupted
+int finishProgress(Progress *p)
+{
+	if (!p->interrupted)
+		poll(p);
+	
+	if (p->verbose) {
+		R_ReleaseObject(p->percentComplete);
+		R_ReleaseObject(p->utilsPackage);
+	}
+	
+	return p->interrupted;
+}
@@ -41,7 +41,7 @@ static const R_CallMethodDef callMethods[] = { // method call, pointer, num args
 	{"multiMatch", (DL_FUNC) &multiMatch, 3},
 	{"multiMatchUpper", (DL_FUNC) &multiMatchUpper, 3},
 	{"multiMatchCharNotNA", (DL_FUNC) &multiMatchCharNotNA, 1},
-	{"replaceChars", (DL_FUNC) &replaceChars, 3},
+	{"replaceChars", (DL_FUNC) &replaceChars, 4},
 	{"replaceChar", (DL_FUNC) &replaceChar, 3},
 	{"intMatch", (DL_FUNC) &intMatch, 2},
 	{"terminalMismatch", (DL_FUNC) &terminalMismatch, 5},
@@ -52,6 +52,7 @@ static const R_CallMethodDef callMethods[] = { // method call, pointer, num args
 	{"calculateFISH", (DL_FUNC) &calculateFISH, 2},
 	{"alignProfiles", (DL_FUNC) &alignProfiles, 16},
 	{"alignProfilesAA", (DL_FUNC) &alignProfilesAA, 13},
+	{"alignProfilesBatch", (DL_FUNC) &alignProfilesBatch, 16},
 	{"consensusProfile", (DL_FUNC) &consensusProfile, 3},
 	{"consensusProfileAA", (DL_FUNC) &consensusProfileAA, 3},
 	{"adjustHeights", (DL_FUNC) &adjustHeights, 1},
@@ -61,6 +62,7 @@ static const R_CallMethodDef callMethods[] = { // method call, pointer, num args
 	{"enumerateGappedSequence", (DL_FUNC) &enumerateGappedSequence, 3},
 	{"enumerateGappedSequenceAA", (DL_FUNC) &enumerateGappedSequenceAA, 3},
 	{"matchOrder", (DL_FUNC) &matchOrder, 4},
+	{"matchOrderSeeds", (DL_FUNC) &matchOrderSeeds, 5},
 	{"matchRanges", (DL_FUNC) &matchRanges, 5},
 	{"firstSeqsEqual", (DL_FUNC) &firstSeqsEqual, 8},
 	{"boundedMatches", (DL_FUNC) &boundedMatches, 3},
@@ -96,7 +98,6 @@ static const R_CallMethodDef callMethods[] = { // method call, pointer, num args
 	{"extractFields", (DL_FUNC) &extractFields, 4},
 	{"intDiff", (DL_FUNC) &intDiff, 1},
 	{"qbit", (DL_FUNC) &qbit, 3},
-	{"movAvg", (DL_FUNC) &movAvg, 7},
 	{"getPools", (DL_FUNC) &getPools, 1},
 	{"predictDBN", (DL_FUNC) &predictDBN, 14},
 	{"informationContent", (DL_FUNC) &informationContent, 4},
@@ -135,21 +136,22 @@ static const R_CallMethodDef callMethods[] = { // method call, pointer, num args
 	{"getIndex", (DL_FUNC) &getIndex, 4},
 	{"getBounds", (DL_FUNC) &getBounds, 12},
 	{"addIfElse", (DL_FUNC) &addIfElse, 3},
-	{"kmerScores", (DL_FUNC) &kmerScores, 4},
+	{"kmerBackground", (DL_FUNC) &kmerBackground, 2},
+	{"kmerScores", (DL_FUNC) &kmerScores, 5},
 	{"getHits", (DL_FUNC) &getHits, 7},
 	{"couplingModel", (DL_FUNC) &couplingModel, 5},
 	{"scoreCouplingModel", (DL_FUNC) &scoreCouplingModel, 4},
 	{"maxPerORF", (DL_FUNC) &maxPerORF, 2},
 	{"replaceGaps", (DL_FUNC) &replaceGaps, 4},
 	{"intMatchSelfOnce", (DL_FUNC) &intMatchSelfOnce, 2},
-	{"scorePWM", (DL_FUNC) &scorePWM, 4},
+	{"scorePWMs", (DL_FUNC) &scorePWMs, 4},
 	{"scoreTopPWM", (DL_FUNC) &scoreTopPWM, 5},
 	{"dist", (DL_FUNC) &dist, 2},
 	{"clusterMP", (DL_FUNC) &clusterMP, 8},
 	{"expM", (DL_FUNC) &expM, 3},
 	{"alignPair", (DL_FUNC) &alignPair, 13},
 	{"overlap", (DL_FUNC) &overlap, 3},
-	{"cophenetic", (DL_FUNC) &cophenetic, 4},
+	{"cophenetic", (DL_FUNC) &cophenetic, 3},
 	{"sumBins", (DL_FUNC) &sumBins, 2},
 	{"dereplicate", (DL_FUNC) &dereplicate, 2},
 	{"selectGroups", (DL_FUNC) &selectGroups, 5},
@@ -157,15 +159,23 @@ static const R_CallMethodDef callMethods[] = { // method call, pointer, num args
 	{"xorShift", (DL_FUNC) &xorShift, 2},
 	{"sortedUnique", (DL_FUNC) &sortedUnique, 1},
 	{"splitPartitions", (DL_FUNC) &splitPartitions, 5},
-	{"searchIndex", (DL_FUNC) &searchIndex, 23},
+	{"searchIndex", (DL_FUNC) &searchIndex, 26},
 	{"detectCores", (DL_FUNC) &detectCores, 0},
 	{"countIndex", (DL_FUNC) &countIndex, 3},
 	{"updateIndex", (DL_FUNC) &updateIndex, 8},
 	{"approxFreqs", (DL_FUNC) &approxFreqs, 3},
-	{"alignPairs", (DL_FUNC) &alignPairs, 15},
+	{"alignPairs", (DL_FUNC) &alignPairs, 16},
 	{"extendMatches", (DL_FUNC) &extendMatches, 14},
 	{"computeOverlap", (DL_FUNC) &computeOverlap, 18},
 	{"withdrawMatches", (DL_FUNC) &withdrawMatches, 11},
+	{"seqStats", (DL_FUNC) &seqStats, 3},
+	{"parseNewick", (DL_FUNC) &parseNewick, 4},
+	{"writeNewick", (DL_FUNC) &writeNewick, 6},
+	{"maskColumns", (DL_FUNC) &maskColumns, 6},
+	{"trimDNA", (DL_FUNC) &trimDNA, 12},
+	{"matchPatterns", (DL_FUNC) &matchPatterns, 5},
+	{"setInstrument", (DL_FUNC) &setInstrument, 3},
+	{"getInstrument", (DL_FUNC) &getInstrument, 1},
 	{NULL, NULL, 0}
 };
 
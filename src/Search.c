@@ -43,6 +43,23 @@
 // DECIPHER header file
 #include "DECIPHER.h"
 
+#define QUERY_BATCH 32 // queries whose k-mers are looked up together
+
+// one occurrence of a k-mer in a query of the batch
+typedef struct {
+	int kmer; // k-mer number
+	int query; // query number within the batch
+	int start; // first position of the k-mer's hits in the query's vectors
+	int pos; // position of the k-mer in the query
+} KmerUse;
+
+static int compareKmerUses(const void *a, const void *b)
+{
+	int x = ((const KmerUse *)a)->kmer;
+	int y = ((const KmerUse *)b)->kmer;
+	return (x > y) - (x < y);
+}
+
 void heapSelect(double *score, int *A, int l, int k)
 {
 	int p, c, temp;
@@ -77,10 +94,38 @@ void heapSelect(double *score, int *A, int l, int k)
 	}
 }
 
+// reverse the order of anchors in a chain into a 4 x anchor[0] matrix
+static void orderAnchors(const int *anchor, int *rans)
+{
+	int c = anchor[0]; // number of anchors
+	int p = 0;
+	int e1 = 0, e2 = 0; // ends
+	while (c > 0) { // reverse anchor order
+		// pull-back anchor overlap due to indels
+		int d1 = anchor[4*c - 3] - e1;
+		int d2 = anchor[4*c - 1] - e2;
+		if (d2 < d1)
+			d1 = d2;
+		if (d1 <= 0) {
+			d1 = 1 - d1;
+		} else {
+			d1 = 0;
+		}
+		rans[p++] = anchor[4*c - 3] + d1;
+		e1 = anchor[4*c - 2];
+		rans[p++] = e1;
+		rans[p++] = anchor[4*c - 1] + d1;
+		e2 = anchor[4*c];
+		rans[p++] = e2;
+		c--;
+	}
+}
+
 // returns hits between queries and targets in an inverted index
-SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP count, SEXP location, SEXP index, SEXP positions, SEXP sepC, SEXP gapC, SEXP total, SEXP minScore, SEXP scoreOnly, SEXP pattern, SEXP subject, SEXP subMatrix, SEXP letters, SEXP dropScore, SEXP limitTarget, SEXP limitQuery, SEXP verbose, SEXP pBar, SEXP nThreads)
+SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP count, SEXP location, SEXP index, SEXP positions, SEXP sepC, SEXP gapC, SEXP total, SEXP minScore, SEXP scoreOnly, SEXP pattern, SEXP subject, SEXP subMatrix, SEXP letters, SEXP dropScore, SEXP limitTarget, SEXP limitQuery, SEXP align, SEXP compact, SEXP bySubject, SEXP verbose, SEXP pBar, SEXP nThreads)
 {
 	int i, j, k, p, c;
+	StageTimer timer = startStage();
 	int n = length(query); // number of sequences in the query
 	int K = asInteger(wordSize); // k-mer length
 	int step = asInteger(stepSize); // separation between k-mers
@@ -94,6 +139,8 @@ SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP c
 	double tot = asReal(total); // total size of target database
 	double minS = asReal(minScore); // minimum score or NA to calculate
 	int sO = asInteger(scoreOnly); // FALSE to output anchor positions
+	int cP = asLogical(compact); // TRUE to output anchors in one matrix
+	int bS = asLogical(bySubject); // TRUE to output the top hit per target
 	int limitT = asInteger(limitTarget);
 	int limitQ = asInteger(limitQuery);
 	int nthreads = asInteger(nThreads);
@@ -125,25 +172,38 @@ SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP c
 		}
 	}
 	
-	// set up a timer to minimize interrupt checks
-	time_t start, end;
-	double elapsed;
-	time(&start);
-	
-	int before, v, *rPercentComplete;
-	double N, soFar;
-	SEXP percentComplete, utilsPackage;
-	v = asLogical(verbose);
-	if (v) { // percent complete variables
-		N = 0; // completed iterations
-		soFar = 0;
-		before = 0;
-		PROTECT(percentComplete = NEW_INTEGER(1));
-		rPercentComplete = INTEGER(percentComplete);
-		// make it possible to access R functions from the utils package for the progress bar
-		PROTECT(utilsPackage = eval(lang2(install("getNamespace"), ScalarString(mkChar("utils"))), R_GlobalEnv));
+	// if align provided then hits are aligned in the same thread
+	int fused = !isNull(align);
+	int bW = 0, aB = 0, *aMM = NULL, *alkup_row = NULL, *alkup_col = NULL;
+	double aGO = 0, aGE = 0, aDS = 0, *aSM = NULL, minA = 0;
+	if (fused) {
+		bW = asInteger(VECTOR_ELT(align, 0));
+		aGO = asReal(VECTOR_ELT(align, 1));
+		aGE = asReal(VECTOR_ELT(align, 2));
+		aDS = asReal(VECTOR_ELT(align, 3));
+		aSM = REAL(VECTOR_ELT(align, 4));
+		aMM = INTEGER(VECTOR_ELT(align, 5));
+		minA = asReal(VECTOR_ELT(align, 7)); // minimum alignment score
+		aB = asLogical(VECTOR_ELT(align, 8)); // adaptive band
+		XStringSet_holder a_set = hold_XStringSet(VECTOR_ELT(align, 6));
+		Chars_holder a_i = get_elt_from_XStringSet_holder(&a_set, 0);
+		alkup_row = (int *) malloc(256*sizeof(int)); // thread-safe on Windows
+		alkup_col = (int *) malloc(256*sizeof(int)); // thread-safe on Windows
+		for (i = 0; i < 256; i++) {
+			alkup_row[i] = NA_INTEGER;
+			alkup_col[i] = NA_INTEGER;
+		}
+		for (i = 0; i < a_i.length; i++) {
+			alkup_row[(unsigned char)a_i.ptr[i]] = i;
+			alkup_col[(unsigned char)a_i.ptr[i]] = i*a_i.length;
+		}
 	}
 	
+	// worker threads count completed queries for the master thread to report
+	int v = asLogical(verbose);
+	Progress prog;
+	initProgress(&prog, n, v, pBar);
+	
 	// determine cost for the distance between k-mer matches
 	double sC = asReal(sepC); // cost for separation between k-mers
 	double gC = asReal(gapC); // cost for minimum gaps between k-mers
@@ -199,45 +259,81 @@ SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP c
 		l[i] = length(VECTOR_ELT(query, i)); // query length
 	}
 	int ***matrices;
-	if (sO == 0)
+	PairAlignment **alignments = NULL;
+	if (fused) {
+		alignments = (PairAlignment **) malloc(n*sizeof(PairAlignment *)); // thread-safe on Windows
+	} else if (sO == 0) {
 		matrices = (int ***) malloc(n*sizeof(int **)); // thread-safe on Windows
+	}
 	
 	int negK = -1*K;
 	int abort = 0;
+	int alignAbort[3] = {0, 0, 0};
+	
+	// queries are searched in batches so that each posting list in the
+	// index is read once for all queries in the batch sharing its k-mer
+	int perBatch = (n + nthreads - 1)/nthreads;
+	if (perBatch > QUERY_BATCH)
+		perBatch = QUERY_BATCH; // queries per batch
+	if (perBatch < 1)
+		perBatch = 1;
+	int B = (n + perBatch - 1)/perBatch; // number of batches
+	
+	int b;
 	#ifdef _OPENMP
 	#pragma omp parallel for private(i,j,k,p,c) schedule(dynamic) num_threads(nthreads)
 	#endif
-	for (i = 0; i < n; i++) { // each sequence
-		if (abort == 0) {
+	for (b = 0; b < B; b++) { // each batch of sequences
+		int first = b*perBatch;
+		int last = first + perBatch;
+		if (last > n)
+			last = n;
+		
+		// vectors of each sequence in the batch
+		int *widths = (int *) malloc((last - first)*sizeof(int)); // thread-safe on Windows
+		int *sizes = (int *) malloc((last - first)*sizeof(int)); // thread-safe on Windows
+		int **countsB = (int **) malloc((last - first)*sizeof(int *)); // thread-safe on Windows
+		int **posQueryB = (int **) malloc((last - first)*sizeof(int *)); // thread-safe on Windows
+		int **posTargetB = (int **) malloc((last - first)*sizeof(int *)); // thread-safe on Windows
+		int **setB = (int **) malloc((last - first)*sizeof(int *)); // thread-safe on Windows
+		double **scoreB = (double **) malloc((last - first)*sizeof(double *)); // thread-safe on Windows
+		double **addScoreB = (double **) malloc((last - first)*sizeof(double *)); // thread-safe on Windows
+		int uses = 0; // number of query k-mers found in targets
+		
+		for (i = first; i < last; i++) { // each sequence
 			int *w = ptrs[i]; // k-mers
-			
-			// record the number of unmasked positions
 			int width = 0; // positions in the query
-			k = -2; // last unmasked position
-			for (j = 0; j < l[i]; j++) { // each k-mer
-				if (w[j] != NA_INTEGER) { // unmasked
-					if (k == j - 1) {
-						width++; // query is always staggered by one position
-					} else {
-						// all masked (NA) positions are at least K long
-						width += K; // new k-mer
+			int s = 0; // total number of k-mers shared with targets
+			int *counts = NULL;
+			sizes[i - first] = -1; // no hits
+			
+			if (abort == 0) {
+				// record the number of unmasked positions
+				k = -2; // last unmasked position
+				for (j = 0; j < l[i]; j++) { // each k-mer
+					if (w[j] != NA_INTEGER) { // unmasked
+						if (k == j - 1) {
+							width++; // query is always staggered by one position
+						} else {
+							// all masked (NA) positions are at least K long
+							width += K; // new k-mer
+						}
+						k = j;
 					}
-					k = j;
 				}
-			}
-			
-			// count target occurrences of each query k-mer
-			int s = 0; // total number of k-mers shared with targets
-			int *counts = (int *) malloc(l[i]*sizeof(int)); // thread-safe on Windows
-			for (j = 0; j < l[i]; j++) { // each query k-mer
-				if (w[j] == NA_INTEGER) {
-					counts[j] = 0;
-				} else {
-					counts[j] = num[w[j]];
-					s += counts[j];
-					if (s < 0) { // signed integer overflow
-						abort = i + 1;
-						break;
+				
+				// count target occurrences of each query k-mer
+				counts = (int *) malloc(l[i]*sizeof(int)); // thread-safe on Windows
+				for (j = 0; j < l[i]; j++) { // each query k-mer
+					if (w[j] == NA_INTEGER) {
+						counts[j] = 0;
+					} else {
+						counts[j] = num[w[j]];
+						s += counts[j];
+						if (s < 0) { // signed integer overflow
+							abort = i + 1;
+							break;
+						}
 					}
 				}
 			}
@@ -251,34 +347,88 @@ SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP c
 				ptrs[i] = set;
 				vecs[i] = score;
 				l[i] = 0; // number of results
-				if (sO == 0) {
+				if (fused) {
+					alignments[i] = (PairAlignment *) malloc(0*sizeof(PairAlignment)); // thread-safe on Windows
+				} else if (sO == 0) {
 					int **anchors = (int **) malloc(0*sizeof(int *)); // thread-safe on Windows
 					matrices[i] = anchors;
 				}
 				continue;
 			}
+			COUNT(COUNT_KMER_HITS, s);
 			
-			// record target occurrences of each query k-mer
-			int *posQuery = (int *) malloc(s*sizeof(int)); // thread-safe on Windows
-			int *posTarget = (int *) malloc(s*sizeof(int)); // thread-safe on Windows
-			int *set = (int *) malloc(s*sizeof(int)); // thread-safe on Windows
-			double *score = (double *) malloc(s*sizeof(double)); // thread-safe on Windows
-			double *addScore = (double *) malloc(s*sizeof(double)); // thread-safe on Windows
-			s = 0;
-			for (j = 0; j < l[i]; j++) { // each query k-mer
+			widths[i - first] = width;
+			sizes[i - first] = s;
+			countsB[i - first] = counts;
+			posQueryB[i - first] = (int *) malloc(s*sizeof(int)); // thread-safe on Windows
+			posTargetB[i - first] = (int *) malloc(s*sizeof(int)); // thread-safe on Windows
+			setB[i - first] = (int *) malloc(s*sizeof(int)); // thread-safe on Windows
+			scoreB[i - first] = (double *) malloc(s*sizeof(double)); // thread-safe on Windows
+			addScoreB[i - first] = (double *) malloc(s*sizeof(double)); // thread-safe on Windows
+			for (j = 0; j < l[i]; j++)
+				if (counts[j] > 0)
+					uses++;
+		}
+		
+		// list where each query k-mer's target occurrences belong
+		KmerUse *use = (KmerUse *) malloc(uses*sizeof(KmerUse)); // thread-safe on Windows
+		k = 0;
+		for (i = first; i < last; i++) {
+			if (sizes[i - first] < 0)
+				continue; // no hits
+			int *w = ptrs[i]; // k-mers
+			int *counts = countsB[i - first];
+			p = 0; // position in the vectors of the sequence
+			for (j = 0; j < l[i]; j++) {
 				if (counts[j] > 0) { // w[j] != NA_INTEGER
-					R_xlen_t P = offset[w[j]]; // position of k-mer in loc and ind
-					for (k = 0; k < counts[j]; k++) { // each target instance of k-mer
-						posQuery[s] = j + 1;
-						posTarget[s] = loc[P];
-						set[s] = ind[P];
-						score[s] = scores[w[j]];
-						addScore[s] = addScores[w[j]];
-						P++;
-						s++;
-					}
+					use[k].kmer = w[j];
+					use[k].query = i - first;
+					use[k].pos = j;
+					use[k].start = p;
+					p += counts[j];
+					k++;
+				}
+			}
+		}
+		qsort(use, uses, sizeof(KmerUse), compareKmerUses);
+		
+		// record target occurrences of each query k-mer by reading
+		// the posting lists once in index order and scattering them
+		j = 0;
+		while (j < uses) {
+			c = j; // first use of the k-mer
+			while (j < uses && use[j].kmer == use[c].kmer)
+				j++;
+			R_xlen_t P = offset[use[c].kmer]; // position of k-mer in loc and ind
+			int count = num[use[c].kmer];
+			double sc = scores[use[c].kmer];
+			double asc = addScores[use[c].kmer];
+			for (k = 0; k < count; k++) { // each target instance of k-mer
+				for (p = c; p < j; p++) { // each query instance of k-mer
+					int q = use[p].query;
+					int d = use[p].start + k;
+					posQueryB[q][d] = use[p].pos + 1;
+					posTargetB[q][d] = loc[P];
+					setB[q][d] = ind[P];
+					scoreB[q][d] = sc;
+					addScoreB[q][d] = asc;
 				}
+				P++;
 			}
+		}
+		free(use);
+		
+		for (i = first; i < last; i++) { // each sequence
+			if (sizes[i - first] < 0)
+				continue; // no hits
+			int width = widths[i - first];
+			int s = sizes[i - first];
+			int *counts = countsB[i - first];
+			int *posQuery = posQueryB[i - first];
+			int *posTarget = posTargetB[i - first];
+			int *set = setB[i - first];
+			double *score = scoreB[i - first];
+			double *addScore = addScoreB[i - first];
 			
 			// merge sort on set then posTarget
 			int *o1 = (int *) malloc(s*sizeof(int)); // thread-safe on Windows
@@ -789,7 +939,7 @@ SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP c
 			vecs[i] = score;
 			l[i] = c; // number of results
 			
-			if (sO == 0) { // include anchor positions with output
+			if (sO == 0 || fused) { // include anchor positions with output
 				int **anchors = (int **) malloc(c*sizeof(int *)); // thread-safe on Windows
 				for (j = 0; j < c; j++) {
 					// measure length of chain
@@ -818,7 +968,75 @@ SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP c
 					}
 					anchors[j] = anchor;
 				}
-				matrices[i] = anchors;
+				
+				if (fused) { // align hits without returning their anchors
+					const char **p_ptrs = (const char **) malloc(c*sizeof(char *)); // thread-safe on Windows
+					int *p_lens = (int *) malloc(c*sizeof(int)); // thread-safe on Windows
+					const char **s_ptrs = (const char **) malloc(c*sizeof(char *)); // thread-safe on Windows
+					int *s_lens = (int *) malloc(c*sizeof(int)); // thread-safe on Windows
+					int *index1 = (int *) malloc(c*sizeof(int)); // thread-safe on Windows
+					int *N = (int *) malloc(c*sizeof(int)); // thread-safe on Windows
+					Chars_holder p_i = get_elt_from_XStringSet_holder(&p_set, i);
+					for (j = 0; j < c; j++) {
+						Chars_holder s_j = get_elt_from_XStringSet_holder(&s_set, set[j] - 1);
+						p_ptrs[j] = p_i.ptr;
+						p_lens[j] = p_i.length;
+						s_ptrs[j] = s_j.ptr;
+						s_lens[j] = s_j.length;
+						index1[j] = i + 1;
+						N[j] = anchors[j][0]; // number of anchors
+						int *anchor = (int *) malloc(4*N[j]*sizeof(int)); // thread-safe on Windows
+						orderAnchors(anchors[j], anchor);
+						free(anchors[j]);
+						anchors[j] = anchor;
+					}
+					
+					PairAlignment *a = (PairAlignment *) malloc(c*sizeof(PairAlignment)); // thread-safe on Windows
+					int err[3];
+					if (alignAnchoredPairs(c, p_ptrs, p_lens, s_ptrs, s_lens, anchors, N, index1, set, 0, bW, aB, aGO, aGE, aDS, aSM, aMM, alkup_row, alkup_col, a, err)) {
+						#ifdef _OPENMP
+						#pragma omp critical
+						#endif
+						{
+							alignAbort[0] = err[0];
+							if (err[0] == 1) { // sequence and letter number
+								alignAbort[1] = err[1];
+								alignAbort[2] = err[2];
+							} else { // anchors are numbered within the batch
+								alignAbort[1] = i + 1; // pattern number
+								alignAbort[2] = set[(err[1] > 0 ? err[1] : -1*err[1]) - 1]; // subject number
+							}
+							abort = -2;
+						}
+					}
+					
+					// keep alignments passing the minimum score
+					k = 0;
+					for (j = 0; j < c; j++) {
+						if (err[0] == 0 && a[j].score >= minA) {
+							set[k] = set[j];
+							score[k] = score[j];
+							a[k++] = a[j];
+						} else {
+							free(a[j].indels1);
+							free(a[j].lengths1);
+							free(a[j].indels2);
+							free(a[j].lengths2);
+						}
+						free(anchors[j]);
+					}
+					l[i] = k; // number of results
+					alignments[i] = a;
+					free(anchors);
+					free(p_ptrs);
+					free(p_lens);
+					free(s_ptrs);
+					free(s_lens);
+					free(index1);
+					free(N);
+				} else {
+					matrices[i] = anchors;
+				}
 			}
 			
 			free(posQuery);
@@ -827,52 +1045,18 @@ SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP c
 			free(chain);
 			free(res);
 			
-			if (v) {
-				#ifdef _OPENMP
-				#pragma omp critical
-				{
-					N++;
-				}
-				#else
-				N++;
-				#endif
-			}
-			
-			#ifdef _OPENMP
-			int master = omp_get_thread_num();
-			#else
-			int master = 0;
-			#endif
-			
-			if (master == 0) { // master thread
-				time(&end);
-				elapsed = difftime(end, start);
-				
-				if (elapsed >= 1) { // at least 1 second has elapsed
-					start = end;
-					abort = checkInterrupt(); // call back to R
-					if (abort == 0 && v) {
-						soFar = N/n;
-						*rPercentComplete = floor(100*soFar);
-						if (*rPercentComplete > before) { // when the percent has changed
-							// tell the progress bar to update in the R console
-							eval(lang4(install("setTxtProgressBar"), pBar, percentComplete, R_NilValue), utilsPackage);
-							before = *rPercentComplete;
-						}
-					}
-				}
-			}
-		} else {
-			int *set = (int *) malloc(0*sizeof(int)); // thread-safe on Windows
-			double *score = (double *) malloc(0*sizeof(double)); // thread-safe on Windows
-			ptrs[i] = set;
-			vecs[i] = score;
-			l[i] = 0; // number of results
-			if (sO == 0) {
-				int **anchors = (int **) malloc(0*sizeof(int *)); // thread-safe on Windows
-				matrices[i] = anchors;
-			}
+			addProgress(&prog, 1);
+			if (pollProgress(&prog)) // master thread calls back to R
+				abort = -1;
 		}
+		free(widths);
+		free(sizes);
+		free(countsB);
+		free(posQueryB);
+		free(posTargetB);
+		free(setB);
+		free(scoreB);
+		free(addScoreB);
 	}
 	
 	free(addScores);
@@ -884,13 +1068,29 @@ SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP c
 		free(lkup_row);
 		free(lkup_col);
 	}
+	if (fused) {
+		free(alkup_row);
+		free(alkup_col);
+	}
+	
+	if (finishProgress(&prog) && abort == 0)
+		abort = -1;
 	
 	int **anchors; // pointers to anchor positions
 	if (abort != 0) { // release memory
 		for (i = 0; i < n; i++) {
 			int *set = ptrs[i];
 			double *score = vecs[i];
-			if (sO == 0) {
+			if (fused) {
+				PairAlignment *a = alignments[i];
+				for (j = 0; j < l[i]; j++) {
+					free(a[j].indels1);
+					free(a[j].lengths1);
+					free(a[j].indels2);
+					free(a[j].lengths2);
+				}
+				free(a);
+			} else if (sO == 0) {
 				anchors = matrices[i];
 				for (j = 0; j < l[i]; j++) {
 					int *anchor = anchors[j];
@@ -905,10 +1105,27 @@ SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP c
 		free(vecs);
 		free(ptrs);
 		free(l);
-		if (sO == 0)
+		if (fused) {
+			free(alignments);
+		} else if (sO == 0) {
 			free(matrices);
+		}
 		
-		if (abort < 0) {
+		if (abort == -2) {
+			if (alignAbort[0] == 1) {
+				if (alignAbort[2] > 0) {
+					error("Unexpected character in pattern[%d] position %d.", alignAbort[1], alignAbort[2]);
+				} else {
+					error("Unexpected character in subject[%d] position %d.", alignAbort[1], -1*alignAbort[2]);
+				}
+			} else if (alignAbort[0] == 2) {
+				error("Overlapping anchors between pattern[%d] and subject[%d].", alignAbort[1], alignAbort[2]);
+			} else if (alignAbort[0] == 3) {
+				error("Out-of-bounds anchors between pattern[%d] and subject[%d].", alignAbort[1], alignAbort[2]);
+			} else {
+				error("Unknown error.");
+			}
+		} else if (abort < 0) {
 			error("Received user interrupt.");
 		} else {
 			error("Too many target k-mer hits for myXStringSet[%d].", abort);
@@ -919,86 +1136,168 @@ SEXP searchIndex(SEXP query, SEXP wordSize, SEXP stepSize, SEXP logFreqs, SEXP c
 	for (i = 0; i < n; i++)
 		c += l[i];
 	
-	SEXP ans, ans0, ans1, ans2, ans3, ret_list;
+	// choose the rows of output as the query and number of each hit
+	int *rowQ = (int *) malloc(c*sizeof(int)); // thread-safe on Windows
+	int *rowJ = (int *) malloc(c*sizeof(int)); // thread-safe on Windows
+	int *hits = NULL; // number of hits per target when by subject
+	if (bS) { // the top scoring hit to each target across queries
+		int nT = length(positions); // number of targets
+		int *bestQ = (int *) malloc(nT*sizeof(int)); // thread-safe on Windows
+		int *bestJ = (int *) malloc(nT*sizeof(int)); // thread-safe on Windows
+		hits = (int *) calloc(nT, sizeof(int)); // initialized to zero (thread-safe on Windows)
+		for (i = 0; i < n; i++) {
+			int *set = ptrs[i];
+			double *score = vecs[i];
+			for (j = 0; j < l[i]; j++) {
+				p = set[j] - 1;
+				if (hits[p] == 0 || score[j] > vecs[bestQ[p]][bestJ[p]]) {
+					bestQ[p] = i;
+					bestJ[p] = j;
+				}
+				hits[p]++;
+			}
+		}
+		c = 0;
+		for (p = 0; p < nT; p++) {
+			if (hits[p] > 0) {
+				rowQ[c] = bestQ[p];
+				rowJ[c] = bestJ[p];
+				hits[c++] = hits[p]; // compact in place
+			}
+		}
+		free(bestQ);
+		free(bestJ);
+	} else { // every hit in order of queries
+		k = 0;
+		for (i = 0; i < n; i++) {
+			for (j = 0; j < l[i]; j++) {
+				rowQ[k] = i;
+				rowJ[k++] = j;
+			}
+		}
+	}
+	
+	SEXP ans, ans0, ans1, ans2, ret_list;
+	SEXP ans3 = R_NilValue, ans4 = R_NilValue, ans5 = R_NilValue, ans6 = R_NilValue; // optional outputs
 	PROTECT(ans0 = allocVector(INTSXP, c));
 	int *rans0 = INTEGER(ans0);
 	PROTECT(ans1 = allocVector(INTSXP, c));
 	int *rans1 = INTEGER(ans1);
 	PROTECT(ans2 = allocVector(REALSXP, c));
 	double *rans2 = REAL(ans2);
-	if (sO == 0)
+	int nprot = 3;
+	PairAlignment *all = NULL; // alignments of all queries
+	if (fused) {
+		all = (PairAlignment *) malloc(c*sizeof(PairAlignment)); // thread-safe on Windows
+	} else if (sO == 0 && cP) { // anchors of all hits in one matrix
+		j = 0; // number of anchors
+		for (k = 0; k < c; k++)
+			j += matrices[rowQ[k]][rowJ[k]][0];
+		PROTECT(ans3 = allocMatrix(INTSXP, 4, j));
+		PROTECT(ans4 = allocVector(INTSXP, c));
+		PROTECT(ans5 = allocVector(INTSXP, c));
+		nprot += 3;
+	} else if (sO == 0) {
 		PROTECT(ans3 = allocVector(VECSXP, c));
+		nprot++;
+	}
 	
-	k = 0; // position in output vectors
+	p = 0; // column in the matrix of anchors
+	for (k = 0; k < c; k++) {
+		i = rowQ[k];
+		j = rowJ[k];
+		rans0[k] = i + 1;
+		rans1[k] = ptrs[i][j];
+		rans2[k] = vecs[i][j];
+		if (fused) {
+			all[k] = alignments[i][j];
+		} else if (sO == 0 && cP) {
+			int *anchor = matrices[i][j];
+			orderAnchors(anchor, INTEGER(ans3) + 4*p);
+			INTEGER(ans4)[k] = p + 1;
+			INTEGER(ans5)[k] = anchor[0];
+			p += anchor[0];
+		} else if (sO == 0) {
+			int *anchor = matrices[i][j];
+			PROTECT(ans = allocMatrix(INTSXP, 4, anchor[0]));
+			orderAnchors(anchor, INTEGER(ans));
+			SET_VECTOR_ELT(ans3, k, ans);
+			UNPROTECT(1);
+		}
+	}
+	free(rowQ);
+	free(rowJ);
+	if (fused) {
+		PROTECT(ans3 = pairAlignmentsAsList(all, c));
+		nprot++;
+	}
+	
+	// release memory
 	for (i = 0; i < n; i++) {
-		int *set = ptrs[i];
-		double *score = vecs[i];
-		if (sO == 0)
-			anchors = matrices[i];
-		for (j = 0; j < l[i]; j++) {
-			rans0[k] = i + 1;
-			rans1[k] = set[j];
-			rans2[k] = score[j];
-			if (sO == 0) {
-				int *anchor = anchors[j];
-				c = anchor[0]; // number of anchors
-				PROTECT(ans = allocMatrix(INTSXP, 4, c));
-				int *rans = INTEGER(ans);
-				p = 0;
-				int e1 = 0, e2 = 0; // ends
-				while (c > 0) { // reverse anchor order
-					// pull-back anchor overlap due to indels
-					int d1 = anchor[4*c - 3] - e1;
-					int d2 = anchor[4*c - 1] - e2;
-					if (d2 < d1)
-						d1 = d2;
-					if (d1 <= 0) {
-						d1 = 1 - d1;
-					} else {
-						d1 = 0;
-					}
-					rans[p++] = anchor[4*c - 3] + d1;
-					e1 = anchor[4*c - 2];
-					rans[p++] = e1;
-					rans[p++] = anchor[4*c - 1] + d1;
-					e2 = anchor[4*c];
-					rans[p++] = e2;
-					c--;
-				}
-				free(anchor);
-				SET_VECTOR_ELT(ans3, k, ans);
-				UNPROTECT(1);
+		if (fused) {
+			PairAlignment *a = alignments[i];
+			for (j = 0; j < l[i]; j++) {
+				free(a[j].indels1);
+				free(a[j].lengths1);
+				free(a[j].indels2);
+				free(a[j].lengths2);
 			}
-			k++;
-		}
-		free(set);
-		free(score);
-		if (sO == 0)
+			free(a);
+		} else if (sO == 0) {
+			anchors = matrices[i];
+			for (j = 0; j < l[i]; j++)
+				free(anchors[j]);
 			free(anchors);
+		}
+		free(ptrs[i]);
+		free(vecs[i]);
 	}
-	
 	free(vecs);
 	free(ptrs);
 	free(l);
-	if (sO == 0) {
-		PROTECT(ret_list = allocVector(VECSXP, 4));
+	if (fused) {
+		free(alignments);
+		free(all);
+	} else if (sO == 0) {
 		free(matrices);
-	} else { // score only
-		PROTECT(ret_list = allocVector(VECSXP, 3));
 	}
 	
+	if (bS) {
+		PROTECT(ans6 = allocVector(INTSXP, c));
+		for (k = 0; k < c; k++)
+			INTEGER(ans6)[k] = hits[k];
+		free(hits);
+		nprot++;
+	}
+	
+	// Pattern, Subject, Score, then optionally Position (or alignments),
+	// the start and count of each hit in the Position matrix, and Hits
+	k = 3;
+	if (sO == 0 || fused)
+		k++;
+	if (sO == 0 && cP && !fused)
+		k += 2;
+	if (bS)
+		k++;
+	PROTECT(ret_list = allocVector(VECSXP, k));
+	nprot++;
+	
 	SET_VECTOR_ELT(ret_list, 0, ans0);
 	SET_VECTOR_ELT(ret_list, 1, ans1);
 	SET_VECTOR_ELT(ret_list, 2, ans2);
-	
-	if (sO == 0) {
-		SET_VECTOR_ELT(ret_list, 3, ans3);
-		UNPROTECT(5);
-	} else { // score only
-		UNPROTECT(4);
+	k = 3;
+	if (sO == 0 || fused)
+		SET_VECTOR_ELT(ret_list, k++, ans3);
+	if (sO == 0 && cP && !fused) {
+		SET_VECTOR_ELT(ret_list, k++, ans4);
+		SET_VECTOR_ELT(ret_list, k++, ans5);
 	}
-	if (v)
-		UNPROTECT(2);
+	if (bS)
+		SET_VECTOR_ELT(ret_list, k, ans6);
+	
+	UNPROTECT(nprot);
+	
+	stopStage(STAGE_SEARCH_INDEX, timer);
 	
 	return ret_list;
 }
@@ -0,0 +1,418 @@
+/****************************************************************************
+ *           Trims Sequences to the High Quality Region Between Patterns    *
+ *                           Author: Erik Wright                            *
+ ****************************************************************************/
+
+// for OpenMP parallel processing
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Rdefines.h is needed for the SEXP typedef, for the error(), INTEGER(),
+ * GET_DIM(), LOGICAL(), NEW_INTEGER(), PROTECT() and UNPROTECT() macros,
+ * and for the NA_INTEGER constant symbol.
+ */
+#include <Rdefines.h>
+
+/*
+ * R_ext/Rdynload.h is needed for the R_CallMethodDef typedef and the
+ * R_registerRoutines() prototype.
+ */
+#include <R_ext/Rdynload.h>
+
+/* for Calloc/Free */
+#include <R_ext/RS.h>
+
+// for math functions
+#include <math.h>
+
+// for calloc/free
+#include <stdlib.h>
+
+// for uint64_t
+#include <stdint.h>
+
+/*
+ * Biostrings_interface.h is needed for the DNAencode(), get_XString_asRoSeq(),
+ * init_match_reporting(), report_match() and reported_matches_asSEXP()
+ * protoypes, and for the COUNT_MRMODE and START_MRMODE constant symbols.
+ */
+#include "Biostrings_interface.h"
+
+// DECIPHER header file
+#include "DECIPHER.h"
+
+// subject letters are fixed and pattern letters may be ambiguous
+#define MATCHES(s, p) (((s) & ~(p)) == 0)
+
+// rightmost end of a pattern matching with at most k mismatches
+// (positions outside the subject count as mismatches)
+static int lastMatch(const unsigned char *p, int l, const unsigned char *s, int n, int k)
+{
+	int i, j, mm;
+	
+	for (j = n - l + k; j >= -k; j--) {
+		mm = 0;
+		for (i = 0; i < l; i++) {
+			if (j + i < 0 || j + i >= n || !MATCHES(s[j + i], p[i])) {
+				if (++mm > k)
+					break;
+			}
+		}
+		if (mm <= k)
+			return j + l;
+	}
+	
+	return 0;
+}
+
+// whether a pattern of up to 64 letters matches a prefix
+// of the subject within edit distance k (Myers' algorithm)
+static int myersPrefix(const uint64_t *peq, int shift, int l, const unsigned char *s, int n, int k)
+{
+	int j, score = l;
+	if (score <= k)
+		return 1;
+	
+	// the edit distance is at least j - l
+	if (n > l + k)
+		n = l + k;
+	
+	uint64_t mask = (l == 64) ? ~((uint64_t)0) : (((uint64_t)1 << l) - 1);
+	uint64_t high = (uint64_t)1 << (l - 1);
+	uint64_t Pv = mask, Mv = 0, Eq, Xv, Xh, Ph, Mh;
+	for (j = 0; j < n; j++) {
+		Eq = peq[s[j]] >> shift;
+		Xv = Eq | Mv;
+		Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+		Ph = Mv | ~(Xh | Pv);
+		Mh = Pv & Xh;
+		if (Ph & high) {
+			score++;
+		} else if (Mh & high) {
+			score--;
+		}
+		Ph = (Ph << 1) | 1; // the match is anchored at the first letter
+		Mh <<= 1;
+		Pv = (Mh | ~(Xv | Ph)) & mask;
+		Mv = Ph & Xv & mask;
+		if (score <= k)
+			return 1;
+	}
+	
+	return 0;
+}
+
+// same as myersPrefix for patterns longer than a machine word
+static int dpPrefix(const unsigned char *p, int l, const unsigned char *s, int n, int k)
+{
+	int i, j, diag, temp;
+	
+	if (l <= k)
+		return 1;
+	if (n > l + k)
+		n = l + k;
+	
+	int *col = (int *) malloc((l + 1)*sizeof(int)); // thread-safe on Windows
+	for (i = 0; i <= l; i++)
+		col[i] = i;
+	
+	int found = 0;
+	for (j = 0; j < n && !found; j++) {
+		diag = col[0];
+		col[0] = j + 1;
+		for (i = 1; i <= l; i++) {
+			temp = col[i];
+			col[i] = diag + (MATCHES(s[j], p[i - 1]) ? 0 : 1);
+			if (temp + 1 < col[i])
+				col[i] = temp + 1;
+			if (col[i - 1] + 1 < col[i])
+				col[i] = col[i - 1] + 1;
+			diag = temp;
+		}
+		if (col[l] <= k)
+			found = 1;
+	}
+	
+	free(col);
+	
+	return found;
+}
+
+// end of a pattern within or overlapping the start of the subject
+// (type is set to 1 for internal and 2 for flanking matches)
+static int findPatternEnd(const unsigned char *p, int l, const uint64_t *peq, const unsigned char *s, int n, double maxDist, int minOverlap, int allowInternal, int *type)
+{
+	int i, L;
+	
+	*type = 0;
+	if (allowInternal) {
+		i = lastMatch(p, l, s, n, (int)floor(l*maxDist));
+		if (i > 0) {
+			*type = 1;
+			return i;
+		}
+	}
+	
+	// find the longest suffix of the pattern matching a prefix of the subject
+	int offset = (l > 64) ? l - 64 : 0; // first position in peq
+	for (L = l - 1; L >= minOverlap; L--) {
+		i = l - L;
+		if (i >= offset) {
+			if (myersPrefix(peq, i - offset, L, s, n, (int)floor((L + 1)*maxDist)))
+				break;
+		} else if (dpPrefix(p + i, L, s, n, (int)floor((L + 1)*maxDist))) {
+			break;
+		}
+	}
+	if (L >= minOverlap) {
+		*type = 2;
+		return L;
+	}
+	
+	return 0;
+}
+
+// longest region between left and right with a low moving average error rate
+static void qualityBounds(const char *q, int m, int k, double a, double t, double mA, int *left, int *right)
+{
+	int j;
+	double b = 1 - a;
+	t *= 2; // moving average is doubled
+	
+	// initialize array of error probabilities
+	double *p = (double *) malloc(m*sizeof(double)); // thread-safe on Windows
+	
+	// initialize arrays of weighted averages
+	double *s1 = (double *) malloc(m*sizeof(double)); // thread-safe on Windows
+	double *s2 = (double *) malloc(m*sizeof(double)); // thread-safe on Windows
+	
+	if (k == 1) { // Phred
+		for (j = 0; j < m; j++)
+			p[j] = pow(10, ((double)q[j] - 33)/-10);
+	} else if (k == 2) { // Solexa
+		for (j = 0; j < m; j++)
+			p[j] = 1 - 1/(1 + pow(10, ((double)q[j] - 64)/-10));
+	} else { // Illumina
+		for (j = 0; j < m; j++)
+			p[j] = pow(10, ((double)q[j] - 64)/-10);
+	}
+	
+	// trailing moving average
+	s1[0] = p[0];
+	for (j = 1; j < m; j++)
+		s1[j] = a*p[j] + b*s1[j - 1];
+	
+	// leading moving average
+	s2[m - 1] = p[m - 1];
+	for (j = m - 2; j >= 0; j--)
+		s2[j] = a*p[j] + b*s2[j + 1];
+	
+	// combined moving average
+	for (j = 0; j < m; j++)
+		s1[j] += s2[j];
+	
+	free(s2);
+	
+	// find the longest region below threshold
+	int longest = 0;
+	int temp = 0;
+	int lastStart = *left;
+	int bestEnd = -2;
+	for (j = *left - 1; j < *right; j++) {
+		if (s1[j] <= t) {
+			if (temp == 0)
+				lastStart = j + 1;
+			temp++;
+			if (temp > longest) {
+				longest = temp;
+				*left = lastStart;
+				bestEnd = j;
+			}
+		} else {
+			temp = 0;
+		}
+	}
+	
+	free(s1);
+	
+	*right = bestEnd + 1;
+	if (longest == 0) {
+		*left = 0;
+	} else {
+		double avgError = 0;
+		for (j = *left - 1; j <= bestEnd; j++)
+			avgError += p[j];
+		avgError /= bestEnd - *left + 2;
+		if (avgError > mA) {
+			*left = 0;
+			*right = -1;
+		}
+	}
+	
+	free(p);
+}
+
+// encode patterns and their bit masks of matching letters
+static int encodePatterns(SEXP x, int rev, unsigned char ***pats, int **lens, uint64_t ***peqs)
+{
+	int i, j, c, l;
+	
+	XStringSet_holder x_set = hold_XStringSet(x);
+	int n = get_length_from_XStringSet_holder(&x_set);
+	*pats = Calloc(n, unsigned char *);
+	*lens = Calloc(n, int);
+	*peqs = Calloc(n, uint64_t *);
+	for (i = 0; i < n; i++) {
+		Chars_holder x_i = get_elt_from_XStringSet_holder(&x_set, i);
+		l = x_i.length;
+		(*lens)[i] = l;
+		(*pats)[i] = Calloc(l + 1, unsigned char);
+		for (j = 0; j < l; j++)
+			(*pats)[i][j] = (unsigned char)x_i.ptr[rev ? l - j - 1 : j];
+		
+		// only the last 64 positions are used with bit vectors
+		int offset = (l > 64) ? l - 64 : 0;
+		(*peqs)[i] = Calloc(256, uint64_t); // initialized to zero
+		for (c = 0; c < 256; c++)
+			for (j = offset; j < l; j++)
+				if (MATCHES(c, (*pats)[i][j]))
+					(*peqs)[i][c] |= (uint64_t)1 << (j - offset);
+	}
+	
+	return n;
+}
+
+static void freePatterns(int n, unsigned char **pats, int *lens, uint64_t **peqs)
+{
+	int i;
+	
+	for (i = 0; i < n; i++) {
+		Free(pats[i]);
+		Free(peqs[i]);
+	}
+	Free(pats);
+	Free(lens);
+	Free(peqs);
+}
+
+// bounds of each sequence between the patterns and of high quality
+SEXP trimDNA(SEXP x, SEXP leftPatterns, SEXP rightPatterns, SEXP maxDistance, SEXP minOverlap, SEXP allowInternal, SEXP quality, SEXP type, SEXP alpha, SEXP thresh, SEXP maxAvg, SEXP nThreads)
+{
+	int i, j, k, v, t;
+	
+	double mD = asReal(maxDistance);
+	int mO = asInteger(minOverlap);
+	int aI = asLogical(allowInternal);
+	int qT = asInteger(type);
+	double a = asReal(alpha);
+	double th = asReal(thresh);
+	double mA = asReal(maxAvg);
+	int nthreads = asInteger(nThreads);
+	
+	XStringSet_holder x_set, q_set;
+	x_set = hold_XStringSet(x);
+	int n = get_length_from_XStringSet_holder(&x_set);
+	if (qT > 0)
+		q_set = hold_XStringSet(quality);
+	
+	// right patterns are matched against the reversed sequences
+	unsigned char **patsL, **patsR;
+	int *lensL, *lensR;
+	uint64_t **peqsL, **peqsR;
+	int nL = encodePatterns(leftPatterns, 0, &patsL, &lensL, &peqsL);
+	int nR = encodePatterns(rightPatterns, 1, &patsR, &lensR, &peqsR);
+	
+	SEXP lefts, rights, counts;
+	PROTECT(lefts = allocVector(INTSXP, n));
+	int *left = INTEGER(lefts);
+	PROTECT(rights = allocVector(INTSXP, n));
+	int *right = INTEGER(rights);
+	char *types = Calloc(n, char); // 2 bits per side
+	
+	#ifdef _OPENMP
+	#pragma omp parallel for private(i,j,k,v,t) schedule(guided) num_threads(nthreads)
+	#endif
+	for (i = 0; i < n; i++) {
+		Chars_holder x_i = get_elt_from_XStringSet_holder(&x_set, i);
+		int m = x_i.length;
+		const unsigned char *s = (const unsigned char *)x_i.ptr;
+		
+		left[i] = 1;
+		for (k = 0; k < nL; k++) {
+			if (lensL[k] < mO)
+				continue;
+			v = findPatternEnd(patsL[k], lensL[k], peqsL[k], s, m, mD, mO, aI, &t) + 1;
+			if (v > left[i]) {
+				left[i] = v;
+				types[i] = (types[i] & ~3) | t;
+			}
+		}
+		
+		right[i] = m;
+		if (nR > 0 && m > 0) {
+			unsigned char *r = (unsigned char *) malloc(m*sizeof(unsigned char)); // thread-safe on Windows
+			for (j = 0; j < m; j++)
+				r[j] = s[m - j - 1];
+			for (k = 0; k < nR; k++) {
+				if (lensR[k] < mO)
+					continue;
+				v = m - findPatternEnd(patsR[k], lensR[k], peqsR[k], r, m, mD, mO, aI, &t);
+				if (v < right[i]) {
+					right[i] = v;
+					types[i] = (types[i] & ~12) | (t << 2);
+				}
+			}
+			free(r);
+		}
+		
+		if (qT > 0 && m > 0) {
+			Chars_holder q_i = get_elt_from_XStringSet_holder(&q_set, i);
+			int l0 = left[i], r0 = right[i];
+			qualityBounds(q_i.ptr, m, qT, a, th, mA, left + i, right + i);
+			if (left[i] != l0)
+				types[i] |= 16;
+			if (right[i] != r0)
+				types[i] |= 32;
+		}
+	}
+	
+	freePatterns(nL, patsL, lensL, peqsL);
+	freePatterns(nR, patsR, lensR, peqsR);
+	
+	// number of sequences with internal and flanking matches
+	// on each side, followed by the number trimmed by quality
+	PROTECT(counts = allocVector(INTSXP, 6));
+	int *c = INTEGER(counts);
+	for (j = 0; j < 6; j++)
+		c[j] = 0;
+	for (i = 0; i < n; i++) {
+		t = types[i];
+		if ((t & 3) == 1) {
+			c[0]++;
+		} else if ((t & 3) == 2) {
+			c[1]++;
+		}
+		if (((t >> 2) & 3) == 1) {
+			c[2]++;
+		} else if (((t >> 2) & 3) == 2) {
+			c[3]++;
+		}
+		if (t & 16)
+			c[4]++;
+		if (t & 32)
+			c[5]++;
+	}
+	Free(types);
+	
+	SEXP ans;
+	PROTECT(ans = allocVector(VECSXP, 3));
+	SET_VECTOR_ELT(ans, 0, lefts);
+	SET_VECTOR_ELT(ans, 1, rights);
+	SET_VECTOR_ELT(ans, 2, counts);
+	
+	UNPROTECT(4);
+	
+	return ans;
+}
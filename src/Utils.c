@@ -320,13 +320,75 @@ SEXP matchListsDual(SEXP x, SEXP y, SEXP verbose, SEXP pBar, SEXP nThreads)
 	return ans;
 }
 
+// distance = 1 - ordered matches (X, Y) / min(length)
+static double orderDistance(int *X, int lx, int *Y, int ly)
+{
+	int link_x = -1, link_y = -1; // last established link between X and Y
+	int matches = 0; // running number of matches
+	int pos_x, pos_y, off; // current position
+	int offset = 1; // distance offset from link
+	int delta, forward;
+	while (offset + link_x < lx && offset + link_y < ly) { // within sequence
+		pos_y = link_y + 1;
+		pos_x = link_x + offset;
+		
+		if (matches) {
+			if (forward) {
+				for (off = 1; off <= offset; off++, pos_x--, pos_y++) {
+					if (X[pos_x] == Y[pos_y]) {
+						link_x = pos_x;
+						link_y = pos_y;
+						offset = 0;
+						matches++;
+					}
+				}
+			} else { // backward
+				for (off = 1; off <= offset; off++, pos_x--, pos_y++) {
+					if (X[lx - pos_x - 1] == Y[ly - pos_y - 1]) {
+						link_x = pos_x;
+						link_y = pos_y;
+						offset = 0;
+						matches++;
+					}
+				}
+			}
+		} else {
+			for (off = 1; off <= offset; off += delta, pos_x -= delta, pos_y += delta) {
+				if (X[pos_x] == Y[pos_y]) {
+					link_x = pos_x;
+					link_y = pos_y;
+					offset = 0;
+					matches++;
+					forward = 1;
+					break;
+				} else if (X[lx - pos_x - 1] == Y[ly - pos_y - 1]) {
+					link_x = pos_x;
+					link_y = pos_y;
+					offset = 0;
+					matches++;
+					forward = 0; // backward
+					break;
+				}
+				delta = (off < 10) ? 1 : (off/5);
+			}
+		}
+		
+		offset++;
+	}
+	
+	if (lx < ly) {
+		return 1 - (double)matches/(double)lx;
+	} else {
+		return 1 - (double)matches/(double)ly;
+	}
+}
+
 // dist matrix = ordered matches (x[i], x[j]) / min(length)
 // requires a list of unsorted integers retaining the order of x
 SEXP matchOrder(SEXP x, SEXP verbose, SEXP pBar, SEXP nThreads)
 {
 	R_xlen_t i, j, size_x = xlength(x);
 	int before, v, *rPercentComplete;
-	int lx, ly, *X, *Y;
 	SEXP ans;
 	PROTECT(ans = allocVector(REALSXP, size_x*(size_x - 1)/2));
 	double *rans = REAL(ans);
@@ -350,79 +412,14 @@ SEXP matchOrder(SEXP x, SEXP verbose, SEXP pBar, SEXP nThreads)
 	}
 	
 	for (i = 0; i < size_x; i++) {
-		X = px[i];
-		lx = l[i];
 		#ifdef _OPENMP
-		#pragma omp parallel for private(j,Y,ly) schedule(guided) num_threads(nthreads)
+		#pragma omp parallel for private(j) schedule(guided) num_threads(nthreads)
 		#endif
-		for (j = i + 1; j < size_x; j++) {
-			Y = px[j];
-			ly = l[j];
-			
-			int link_x = -1, link_y = -1; // last established link between X and Y
-			int matches = 0; // running number of matches
-			int pos_x, pos_y, off; // current position
-			int offset = 1; // distance offset from link
-			int delta, forward;
-			while (offset + link_x < lx && offset + link_y < ly) { // within sequence
-				pos_y = link_y + 1;
-				pos_x = link_x + offset;
-				
-				if (matches) {
-					if (forward) {
-						for (off = 1; off <= offset; off++, pos_x--, pos_y++) {
-							if (X[pos_x] == Y[pos_y]) {
-								link_x = pos_x;
-								link_y = pos_y;
-								offset = 0;
-								matches++;
-							}
-						}
-					} else { // backward
-						for (off = 1; off <= offset; off++, pos_x--, pos_y++) {
-							if (X[lx - pos_x - 1] == Y[ly - pos_y - 1]) {
-								link_x = pos_x;
-								link_y = pos_y;
-								offset = 0;
-								matches++;
-							}
-						}
-					}
-				} else {
-					for (off = 1; off <= offset; off += delta, pos_x -= delta, pos_y += delta) {
-						if (X[pos_x] == Y[pos_y]) {
-							link_x = pos_x;
-							link_y = pos_y;
-							offset = 0;
-							matches++;
-							forward = 1;
-							break;
-						} else if (X[lx - pos_x - 1] == Y[ly - pos_y - 1]) {
-							link_x = pos_x;
-							link_y = pos_y;
-							offset = 0;
-							matches++;
-							forward = 0; // backward
-							break;
-						}
-						delta = (off < 10) ? 1 : (off/5);
-					}
-				}
-				
-				offset++;
-			}
-			
-			if (lx < ly) {
-				rans[size_x*i - i*(i + 1)/2 + j - i - 1] = 1 - (double)matches/(double)lx;
-			} else {
-				rans[size_x*i - i*(i + 1)/2 + j - i - 1] = 1 - (double)matches/(double)ly;
-			}
-		}
+		for (j = i + 1; j < size_x; j++)
+			rans[size_x*i - i*(i + 1)/2 + j - i - 1] = orderDistance(px[i], l[i], px[j], l[j]);
 		
 		if (v) {
 			// print the percent completed so far
-			//*rPercentComplete = floor(100*((double)i/((double)size_x - 1)));
-			//*rPercentComplete = floor(100*(double)((i + 1)*size_x+(i + 1))/((size_x - 1)*size_x+(size_x - 1)));
 			*rPercentComplete = floor(100*(double)(2*size_x - 2 - i)*(i + 1)/((size_x - 1)*size_x));
 			
 			if (*rPercentComplete > before) { // when the percent has changed
@@ -446,6 +443,57 @@ SEXP matchOrder(SEXP x, SEXP verbose, SEXP pBar, SEXP nThreads)
 	return ans;
 }
 
+// matrix of distances (as in matchOrder) from every x to the seeds
+// that embeds the sequences in a space of length(seeds) dimensions
+SEXP matchOrderSeeds(SEXP x, SEXP seeds, SEXP verbose, SEXP pBar, SEXP nThreads)
+{
+	R_xlen_t i, size_x = xlength(x);
+	int j, s = length(seeds);
+	int *S = INTEGER(seeds);
+	int v = asLogical(verbose);
+	int nthreads = asInteger(nThreads);
+	
+	SEXP ans;
+	PROTECT(ans = allocMatrix(REALSXP, size_x, s));
+	double *rans = REAL(ans);
+	
+	int **px = (int **) malloc(size_x*sizeof(int *)); // thread-safe on Windows
+	int *l = (int *) malloc(size_x*sizeof(int)); // thread-safe on Windows
+	for (i = 0; i < size_x; i++) {
+		px[i] = INTEGER(VECTOR_ELT(x, i));
+		l[i] = length(VECTOR_ELT(x, i));
+	}
+	
+	Progress prog;
+	initProgress(&prog, size_x, v, pBar);
+	#ifdef _OPENMP
+	#pragma omp parallel for private(i,j) schedule(guided) num_threads(nthreads)
+	#endif
+	for (i = 0; i < size_x; i++) {
+		if (progressInterrupted(&prog))
+			continue;
+		for (j = 0; j < s; j++) {
+			int k = S[j] - 1;
+			if (k == i) {
+				rans[i + j*size_x] = 0;
+			} else {
+				rans[i + j*size_x] = orderDistance(px[i], l[i], px[k], l[k]);
+			}
+		}
+		addProgress(&prog, 1);
+		pollProgress(&prog); // master thread calls back to R
+	}
+	free(px);
+	free(l);
+	
+	if (finishProgress(&prog))
+		error("Received user interrupt.");
+	
+	UNPROTECT(1);
+	
+	return ans;
+}
+
 // returns shared ranges between pairs in two unordered (gapped) lists
 SEXP matchRanges(SEXP x, SEXP y, SEXP wordSize, SEXP maxLength, SEXP threshold)
 {